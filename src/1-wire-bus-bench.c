@@ -0,0 +1,185 @@
+/* 1-wire-bus-bench.c
+ *
+ * Measure the throughput of the emulated 1-wire bus.
+ *
+ * A master writes a number of bytes to the bus, which a slave reads back.
+ * Both run as bus members, so this measures the cost of a bus cycle and
+ * the coroutine switches around it, and nothing else.  By default both
+ * sides transfer single bytes, like the emulated devices do; given a
+ * block size they use block transfers instead.  Idle members that only
+ * wait for a reset pulse, like unaddressed devices do, can be added to
+ * show they do not slow down the bus.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "1-wire-bus.h"
+
+#define BENCH_BYTES_DEFAULT	1000000
+#define BENCH_BLOCK_MAX		4096
+#define BENCH_IDLE_MAX		1024
+#define BENCH_IDLE_STACK_SIZE	16384
+
+struct bench_member
+{
+	struct one_wire_bus_member	member;
+	long				bytes;
+	long				block;
+	long				done;
+	uint8_t				buf[BENCH_BLOCK_MAX];
+	int				mismatch;
+};
+
+static void
+bench_master(void *arg)
+{
+	struct bench_member *m = (struct bench_member *)arg;
+	long i;
+
+	if (m->block == 0) {
+		for (m->done = 0; m->done < m->bytes; m->done++)
+			one_wire_bus_member_tx_byte(&m->member, m->done & 0xFF);
+		return;
+	}
+
+	for (m->done = 0; m->done < m->bytes; m->done += m->block) {
+		for (i = 0; i < m->block; i++)
+			m->buf[i] = (m->done + i) & 0xFF;
+
+		one_wire_bus_member_tx_block(&m->member, m->buf, NULL, m->block);
+	}
+}
+
+static void
+bench_slave(void *arg)
+{
+	struct bench_member *m = (struct bench_member *)arg;
+	long i;
+	int byte;
+
+	if (m->block != 0) {
+		for (m->done = 0; ; m->done += m->block) {
+			if (one_wire_bus_member_tx_block(&m->member, NULL,
+			    m->buf, m->block) < 0)
+				break;
+
+			for (i = 0; i < m->block; i++) {
+				if (m->buf[i] != ((m->done + i) & 0xFF))
+					m->mismatch = 1;
+			}
+		}
+		return;
+	}
+
+	for (m->done = 0; ; m->done++) {
+		if ( (byte = one_wire_bus_member_rx_byte(&m->member)) < 0)
+			break;
+
+		if (byte != (m->done & 0xFF))
+			m->mismatch = 1;
+	}
+}
+
+static void
+bench_idle(void *arg)
+{
+	struct bench_member *m = (struct bench_member *)arg;
+
+	while (one_wire_bus_member_reset_wait(&m->member) >= 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	static struct bench_member idle[BENCH_IDLE_MAX];
+	struct bench_member master, slave;
+	struct timespec start, end;
+	struct coroutine_scheduler sched;
+	struct one_wire_bus bus;
+	double elapsed;
+	long bytes, block, idles;
+
+	bytes = argc > 1 ? atol(argv[1]) : BENCH_BYTES_DEFAULT;
+	block = argc > 2 ? atol(argv[2]) : 0;
+	idles = argc > 3 ? atol(argv[3]) : 0;
+	if (bytes <= 0 || block < 0 || block > BENCH_BLOCK_MAX ||
+	    (block != 0 && bytes % block != 0) ||
+	    idles < 0 || idles > BENCH_IDLE_MAX) {
+		fprintf(stderr, "Usage: %s [bytes] [block size] [idle members]\n",
+		        argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	/* Fault in the idle member stacks before we measure anything. */
+	coroutine_scheduler_init(&sched);
+	if (coroutine_scheduler_stack_reserve(&sched, BENCH_IDLE_STACK_SIZE,
+	                                      idles) == -1) {
+		perror("coroutine_scheduler_stack_reserve()");
+		exit(EXIT_FAILURE);
+	}
+	one_wire_bus_init(&bus, &sched);
+
+	one_wire_bus_member_init(&master.member);
+	one_wire_bus_member_master_set(&master.member);
+	master.member.device = &master;
+	master.member.driver = bench_master;
+	master.bytes         = bytes;
+	master.block         = block;
+	master.mismatch      = 0;
+
+	one_wire_bus_member_init(&slave.member);
+	slave.member.device = &slave;
+	slave.member.driver = bench_slave;
+	slave.bytes         = bytes;
+	slave.block         = block;
+	slave.mismatch      = 0;
+
+	for (long i = 0; i < idles; i++) {
+		one_wire_bus_member_init(&idle[i].member);
+		idle[i].member.device     = &idle[i];
+		idle[i].member.driver     = bench_idle;
+		idle[i].member.stack_size = BENCH_IDLE_STACK_SIZE;
+		if (one_wire_bus_member_add(&idle[i].member, &bus) == -1) {
+			fprintf(stderr, "Cannot add idle member %ld.\n", i);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	one_wire_bus_member_add(&slave.member, &bus);
+	one_wire_bus_member_add(&master.member, &bus);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	one_wire_bus_run(&bus);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+	          (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	if (slave.done != bytes || slave.mismatch) {
+		fprintf(stderr, "Slave read %ld of %ld bytes%s.\n", slave.done,
+		        bytes, slave.mismatch ? " with errors" : "");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%ld bytes in %.3fs: %.0f bytes/s\n", bytes, elapsed,
+	       bytes / elapsed);
+
+	return 0;
+}
@@ -29,11 +29,164 @@
 #define DEBUG_LOG(x, ...)
 #endif
 
+/* Resolve 'bytes' whole bytes on the bus.  Every member taking part in
+ * the transfer is byte aligned, so the wired-AND can be done a byte at a
+ * time instead of a bit at a time.  Members sending a pattern repeat it
+ * every byte, so they only need it rotated to where they are in it.
+ */
+static void
+__one_wire_bus_resolve_bytes(struct one_wire_bus *bus, size_t bytes)
+{
+	struct list_head *lh;
+	uint8_t value = 0xFF;
+
+	for (size_t i = 0; i < bytes; i++) {
+		value = 0xFF;
+
+		list_for_each (lh, &bus->pending) {
+			struct one_wire_bus_member *m =
+				list_entry(lh, struct one_wire_bus_member, access_entry);
+
+			if (m->bus_access == ONE_WIRE_BUS_ACCESS_PATTERN)
+				value &= (m->tx_buf >> m->offset) |
+				         (m->tx_buf << (8 - m->offset));
+			else if (m->tx != NULL)
+				value &= m->tx[m->offset / 8 + i];
+		}
+
+		list_for_each (lh, &bus->pending) {
+			struct one_wire_bus_member *m =
+				list_entry(lh, struct one_wire_bus_member, access_entry);
+
+			if (m->rx != NULL)
+				m->rx[m->offset / 8 + i] = value;
+		}
+	}
+
+	list_for_each (lh, &bus->pending) {
+		struct one_wire_bus_member *m =
+			list_entry(lh, struct one_wire_bus_member, access_entry);
+
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_TRANSFER)
+			m->offset += bytes * 8;
+	}
+
+	bus->signal = value >> 7;
+}
+
+/* Resolve a single bit on the bus. */
+static void
+__one_wire_bus_resolve_bit(struct one_wire_bus *bus)
+{
+	struct list_head *lh;
+	int signal = ONE_WIRE_BUS_SIGNAL_ONE;
+
+	list_for_each (lh, &bus->pending) {
+		struct one_wire_bus_member *m =
+			list_entry(lh, struct one_wire_bus_member, access_entry);
+
+		if (m->tx != NULL)
+			signal &= m->tx[m->offset / 8] >> (m->offset % 8);
+	}
+
+	list_for_each (lh, &bus->pending) {
+		struct one_wire_bus_member *m =
+			list_entry(lh, struct one_wire_bus_member, access_entry);
+		uint8_t mask;
+
+		if (m->rx != NULL) {
+			mask = 1 << (m->offset % 8);
+			m->rx[m->offset / 8] &= ~mask;
+			m->rx[m->offset / 8] |= signal ? mask : 0;
+		}
+
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_PATTERN)
+			m->offset = (m->offset + 1) % 8;
+		else
+			m->offset++;
+	}
+
+	bus->signal = signal;
+}
+
+/* Resolve the transfers of all members accessing the bus as far as
+ * possible.  If one of them pulls a reset, all transfers are aborted and
+ * the parked members are woken up.  Otherwise we move all members along
+ * by the largest number of whole bytes that none of them will overrun,
+ * or by a single bit when any of them is not byte aligned, such as during
+ * a search.
+ */
+static void
+__one_wire_bus_resolve(struct one_wire_bus *bus)
+{
+	struct list_head *lh, *lh2;
+	size_t bits = SIZE_MAX;
+	int aligned = 1;
+	int reset = 0;
+
+	list_for_each (lh, &bus->pending) {
+		struct one_wire_bus_member *m =
+			list_entry(lh, struct one_wire_bus_member, access_entry);
+
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_RESET) {
+			reset = 1;
+			continue;
+		}
+
+		/* Patterns never end, and fit any byte boundary. */
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_PATTERN)
+			continue;
+
+		if (m->bits - m->offset < bits)
+			bits = m->bits - m->offset;
+
+		if (m->offset % 8 != 0)
+			aligned = 0;
+	}
+
+	if (reset) {
+		list_splice_tail_init(&bus->parked, &bus->pending);
+
+		list_for_each (lh, &bus->pending) {
+			struct one_wire_bus_member *m =
+				list_entry(lh, struct one_wire_bus_member, access_entry);
+
+			m->status     = ONE_WIRE_BUS_SIGNAL_RESET;
+			m->bus_access = ONE_WIRE_BUS_ACCESS_NONE;
+		}
+
+		list_splice_tail_init(&bus->pending, &bus->ready);
+		bus->signal = ONE_WIRE_BUS_SIGNAL_RESET;
+		return;
+	}
+
+	/* Nobody is accessing the bus. */
+	if (bits == SIZE_MAX)
+		return;
+
+	if (aligned && bits >= 8)
+		__one_wire_bus_resolve_bytes(bus, bits / 8);
+	else
+		__one_wire_bus_resolve_bit(bus);
+
+	/* Finished transfers go back to their members on the next cycle. */
+	list_for_each_safe (lh, lh2, &bus->pending) {
+		struct one_wire_bus_member *m =
+			list_entry(lh, struct one_wire_bus_member, access_entry);
+
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_TRANSFER &&
+		    m->offset == m->bits) {
+			m->status     = 0;
+			m->bus_access = ONE_WIRE_BUS_ACCESS_NONE;
+			list_move_tail(&m->access_entry, &bus->ready);
+		}
+	}
+}
+
 static inline int
 __one_wire_bus_cycle(struct one_wire_bus *bus)
 {
 	struct list_head *lh, *lh2;
-	int signal;
 
 	assert(bus != NULL);
 
@@ -45,52 +198,58 @@ __one_wire_bus_cycle(struct one_wire_bus *bus)
 	if (list_empty(&bus->members))
 		return -1;
 
-	/* Default to a 1 signalled by positive voltage. */
-	signal = ONE_WIRE_BUS_SIGNAL_ONE;
+	/* If we are terminating, we send all members the signal. */
+	if (bus->state == ONE_WIRE_BUS_STATE_TERMINATED) {
+		bus->signal = ONE_WIRE_BUS_SIGNAL_TERMINATE;
 
-	/* In a single bus cycle, we first iterate over all members that are
-	 * not yet accessing the bus.  To keep every member in lock-step it
-	 * is necessary to wait until every member is accessing the bus for
-	 * either read or write operations.
-	 */
-	list_for_each_safe (lh, lh2, &bus->members) {
-		int tmp;
-		struct one_wire_bus_member *m =
-			list_entry(lh, struct one_wire_bus_member, list_entry);
+		list_for_each_safe (lh, lh2, &bus->members) {
+			struct one_wire_bus_member *m =
+				list_entry(lh, struct one_wire_bus_member, list_entry);
 
-		/* If we are terminating, we send all members the signal. */
-		if (bus->state == ONE_WIRE_BUS_STATE_TERMINATED) {
-			bus->signal = ONE_WIRE_BUS_SIGNAL_TERMINATE;
+			m->status     = ONE_WIRE_BUS_SIGNAL_TERMINATE;
+			m->bus_access = ONE_WIRE_BUS_ACCESS_NONE;
 			coroutine_yieldto(&bus->coro, &m->coro);
-			continue;
 		}
 
-		if (m->bus_access != ONE_WIRE_BUS_ACCESS_NONE)
-			continue;
+		return 0;
+	}
 
-		/* The 1-wire signal is a logical and over all devices on the
-		 * line.  If one pulls the line low, it will be low.
-		 */
-		tmp = (int)(intptr_t)coroutine_await(&bus->coro, &m->coro);
-
-		/* It's possible the bus member disappeared during our await,
-		 * so we check if it is still present.  If not we skip
-		 * updating the signal.
-		 *
-		 * XXX: maybe try to solve this in coroutine.c
-		 */
-		if (list_empty(&m->list_entry))
-			continue;
+	/* In a single bus cycle, we first run all members on the ready list
+	 * until they access the bus.  To keep every member in lock-step it
+	 * is necessary to wait until every member is accessing the bus,
+	 * either for a transfer or a reset.  Members in the middle of a
+	 * transfer are not woken up until it has finished, and members
+	 * waiting for a reset are parked until one happens, so a cycle only
+	 * costs as much as the members that are actually using the bus.
+	 */
+	while (!list_empty(&bus->ready)) {
+		struct one_wire_bus_member *m =
+			list_entry(bus->ready.next, struct one_wire_bus_member,
+			           access_entry);
 
-		if (tmp == -1)
-			signal = -1;
-		else if (signal != -1)
-			signal &= tmp;
+		coroutine_await(&bus->coro, &m->coro);
 
-		DEBUG_LOG("[1-wire-bus] %s signal %d\n", m->name, signal);
+		/* The member may have left the bus. */
+		if (m->bus != bus)
+			continue;
+
+		if (m->bus_access == ONE_WIRE_BUS_ACCESS_RESET_WAIT)
+			list_move_tail(&m->access_entry, &bus->parked);
+		else
+			list_move_tail(&m->access_entry, &bus->pending);
 	}
 
-	bus->signal = signal;
+	/* The master may have gone away during our await, in which case
+	 * we terminate on the next cycle instead.  We do the same when all
+	 * remaining members wait for a reset nobody can send anymore.
+	 */
+	if (list_empty(&bus->pending))
+		bus->state = ONE_WIRE_BUS_STATE_TERMINATED;
+
+	if (bus->state == ONE_WIRE_BUS_STATE_TERMINATED)
+		return 0;
+
+	__one_wire_bus_resolve(bus);
 	DEBUG_LOG("[1-wire-bus] final bus signal %d\n", bus->signal);
 
 	return 0;
@@ -140,15 +299,23 @@ __one_wire_bus_member_destructor(struct coroutine *coro)
 	one_wire_bus_member_remove(member);
 }
 
-void one_wire_bus_init(struct one_wire_bus *bus)
+/* The bus and all its members run as coroutines on 'sched'. */
+void one_wire_bus_init(struct one_wire_bus *bus,
+                       struct coroutine_scheduler *sched)
 {
 	assert(bus != NULL);
+	assert(sched != NULL);
 
 	memset(bus, 0, sizeof *bus);
+	bus->sched  = sched;
 	bus->state  = ONE_WIRE_BUS_STATE_TERMINATED;
 	bus->signal = ONE_WIRE_BUS_SIGNAL_ONE;
 	list_init(&bus->members);
-	coroutine_init(&bus->coro, __one_wire_bus_coroutine, bus);
+	list_init(&bus->ready);
+	list_init(&bus->pending);
+	list_init(&bus->parked);
+	coroutine_init_stack(&bus->coro, sched, __one_wire_bus_coroutine, bus,
+	                     ONE_WIRE_BUS_STACK_SIZE);
 }
 
 void one_wire_bus_member_init(struct one_wire_bus_member *member)
@@ -159,6 +326,7 @@ void one_wire_bus_member_init(struct one_wire_bus_member *member)
 	member->type       = ONE_WIRE_BUS_MEMBER_SLAVE;
 	member->bus_access = ONE_WIRE_BUS_ACCESS_NONE;
 	list_init(&member->list_entry);
+	list_init(&member->access_entry);
 }
 
 int
@@ -171,9 +339,14 @@ one_wire_bus_member_add(struct one_wire_bus_member *member,
 
 	DEBUG_LOG("[1-wire-bus] Adding member `%s'\n", member->name);
 
+	if (coroutine_init_stack(&member->coro, bus->sched,
+	                         __one_wire_bus_member_coroutine, member,
+	                         member->stack_size) == -1)
+		return -1;
+
 	member->bus = bus;
 	list_add(&member->list_entry, &bus->members);
-	coroutine_init(&member->coro, __one_wire_bus_member_coroutine, member);
+	list_add(&member->access_entry, &bus->ready);
 	coroutine_destructor_set(&member->coro, __one_wire_bus_member_destructor);
 
 	return 0;
@@ -197,31 +370,65 @@ one_wire_bus_member_remove(struct one_wire_bus_member *member)
 
 	member->bus = NULL;
 	list_del_init(&member->list_entry);
+	list_del_init(&member->access_entry);
 }
 
-int
-one_wire_bus_member_tx_bit(struct one_wire_bus_member *member, int bit)
+/* Hand a transfer of 'bits' bits to the bus, and wait until it has been
+ * completed.  The bits in 'tx' are sent least significant bit first, and
+ * 'rx' receives the bits seen on the bus.  If 'tx' is NULL we only read,
+ * which means releasing the line.
+ */
+static int
+__one_wire_bus_member_transfer(struct one_wire_bus_member *member,
+                               const uint8_t *tx, uint8_t *rx, size_t bits)
 {
 	assert(member != NULL);
 	assert(member->bus != NULL);
+
+	member->tx         = tx;
+	member->rx         = rx;
+	member->bits       = bits;
+	member->offset     = 0;
+	member->bus_access = ONE_WIRE_BUS_ACCESS_TRANSFER;
+
+	/* Only the bus completes our transfer, so if anything else wakes us
+	 * up early we go straight back.
+	 */
+	do {
+		coroutine_returnto(&member->coro, &member->bus->coro, NULL);
+	} while (member->bus_access != ONE_WIRE_BUS_ACCESS_NONE);
+
+	return member->status;
+}
+
+int
+one_wire_bus_member_tx_bit(struct one_wire_bus_member *member, int bit)
+{
+	int ret;
+
 	assert(bit == 0 || bit == 1);
 
-	coroutine_returnto(&member->coro, &member->bus->coro, (void *)(intptr_t)bit);
-	DEBUG_LOG("[1-wire-bus] %s tx %d rx %d\n", member->name, bit, member->bus->signal);
-	return member->bus->signal;
+	member->tx_buf = bit;
+	ret = __one_wire_bus_member_transfer(member, &member->tx_buf,
+	                                     &member->rx_buf, 1);
+	if (ret < 0)
+		return ret;
+
+	DEBUG_LOG("[1-wire-bus] %s tx %d rx %d\n", member->name, bit, member->rx_buf & 1);
+	return member->rx_buf & 1;
 }
 
 int
 one_wire_bus_member_rx_bit(struct one_wire_bus_member *member)
 {
-	assert(member != NULL);
-	assert(member->bus != NULL);
-
-	coroutine_returnto(&member->coro, &member->bus->coro, (void *)1);
+	int ret;
 
-	DEBUG_LOG("[1-wire-bus] %s rx %d\n", member->name, member->bus->signal);
+	ret = __one_wire_bus_member_transfer(member, NULL, &member->rx_buf, 1);
+	if (ret < 0)
+		return ret;
 
-	return member->bus->signal;
+	DEBUG_LOG("[1-wire-bus] %s rx %d\n", member->name, member->rx_buf & 1);
+	return member->rx_buf & 1;
 }
 
 void
@@ -230,48 +437,107 @@ one_wire_bus_member_reset_pulse(struct one_wire_bus_member *member)
 	assert(member != NULL);
 	assert(member->bus != NULL);
 
-	coroutine_returnto(&member->coro, &member->bus->coro, (void *)-1);
+	member->bus_access = ONE_WIRE_BUS_ACCESS_RESET;
+
+	do {
+		coroutine_returnto(&member->coro, &member->bus->coro, NULL);
+	} while (member->bus_access != ONE_WIRE_BUS_ACCESS_NONE);
+
 	DEBUG_LOG("[1-wire-bus] %s tx reset pulse\n", member->name);
 }
 
-int one_wire_bus_member_rx_byte(struct one_wire_bus_member *member)
+/* Stay off the bus until another member sends a reset pulse.  Returns
+ * ONE_WIRE_BUS_SIGNAL_RESET, or ONE_WIRE_BUS_SIGNAL_TERMINATE if the bus
+ * shuts down first.
+ */
+int
+one_wire_bus_member_reset_wait(struct one_wire_bus_member *member)
 {
-	int result = 0;
-	int bit;
-	int i;
+	assert(member != NULL);
+	assert(member->bus != NULL);
 
-	for (i = 0; i < 8; i++) {
-		bit = one_wire_bus_member_rx_bit(member);
+	member->bus_access = ONE_WIRE_BUS_ACCESS_RESET_WAIT;
 
-		if (bit == ONE_WIRE_BUS_SIGNAL_RESET)
-			return ONE_WIRE_BUS_SIGNAL_RESET;
+	do {
+		coroutine_returnto(&member->coro, &member->bus->coro, NULL);
+	} while (member->bus_access != ONE_WIRE_BUS_ACCESS_NONE);
 
-		result |= bit << i;
-	}
+	DEBUG_LOG("[1-wire-bus] %s rx reset pulse\n", member->name);
+	return member->status;
+}
+
+int one_wire_bus_member_rx_byte(struct one_wire_bus_member *member)
+{
+	int ret;
 
-	return result;
+	ret = __one_wire_bus_member_transfer(member, NULL, &member->rx_buf, 8);
+	if (ret < 0)
+		return ret;
+
+	return member->rx_buf;
 }
 
 int
 one_wire_bus_member_tx_byte(struct one_wire_bus_member *member, int byte)
 {
-	int result = 0;
-	int bit;
+	int ret;
 
-	for (int i = 0; i < 8; i++) {
-		bit = one_wire_bus_member_tx_bit(member, (byte >> i) & 1);
+	member->tx_buf = byte;
+	ret = __one_wire_bus_member_transfer(member, &member->tx_buf,
+	                                     &member->rx_buf, 8);
+	if (ret < 0)
+		return ret;
 
-		if (bit == ONE_WIRE_BUS_SIGNAL_RESET)
-			return ONE_WIRE_BUS_SIGNAL_RESET;
+	return member->rx_buf;
+}
 
-		result |= bit << i;
-	}
+/* Transfer 'len' bytes at once.  Either 'tx' or 'rx' can be NULL, and
+ * they can be the same buffer.  Returns 0 on success, or the signal that
+ * interrupted the transfer.
+ */
+int
+one_wire_bus_member_tx_block(struct one_wire_bus_member *member,
+                             const uint8_t *tx, uint8_t *rx, size_t len)
+{
+	if (len == 0)
+		return 0;
+
+	return __one_wire_bus_member_transfer(member, tx, rx, len * 8);
+}
+
+/* Send the low 'bits' bits of 'pattern' over and over, until the next
+ * reset pulse.  The bus answers the other members from the pattern by
+ * itself, so we are not run again for every bit.  'bits' must be 1, 2,
+ * 4 or 8.  Returns the signal that ended the pattern.
+ */
+int
+one_wire_bus_member_tx_pattern(struct one_wire_bus_member *member,
+                               int pattern, size_t bits)
+{
+	assert(member != NULL);
+	assert(member->bus != NULL);
+	assert(bits == 1 || bits == 2 || bits == 4 || bits == 8);
+
+	/* Repeat the pattern to fill a byte. */
+	member->tx_buf = pattern & ((1 << bits) - 1);
+	for (size_t i = bits; i < 8; i *= 2)
+		member->tx_buf |= member->tx_buf << i;
+
+	member->tx         = &member->tx_buf;
+	member->rx         = NULL;
+	member->bits       = SIZE_MAX;
+	member->offset     = 0;
+	member->bus_access = ONE_WIRE_BUS_ACCESS_PATTERN;
+
+	do {
+		coroutine_returnto(&member->coro, &member->bus->coro, NULL);
+	} while (member->bus_access != ONE_WIRE_BUS_ACCESS_NONE);
 
-	return result;
+	return member->status;
 }
 
 int one_wire_bus_run(struct one_wire_bus *bus)
 {
 	bus->state = ONE_WIRE_BUS_STATE_RUNNING;
-	return coroutine_main();
+	return coroutine_scheduler_run(bus->sched);
 }
@@ -23,6 +23,7 @@
 #define ONE_WIRE_BUS_H
 
 #include <inttypes.h>
+#include <stddef.h>
 #include "coroutine.h"
 #include "debug.h"
 #include "list.h"
@@ -34,8 +35,10 @@
 #define ONE_WIRE_BUS_SIGNAL_ONE		1
 
 #define ONE_WIRE_BUS_ACCESS_NONE	0
-#define ONE_WIRE_BUS_ACCESS_READ	1
-#define ONE_WIRE_BUS_ACCESS_WRITE	2
+#define ONE_WIRE_BUS_ACCESS_TRANSFER	1
+#define ONE_WIRE_BUS_ACCESS_RESET	2
+#define ONE_WIRE_BUS_ACCESS_RESET_WAIT	3
+#define ONE_WIRE_BUS_ACCESS_PATTERN	4
 
 #define ONE_WIRE_BUS_STATE_RUNNING	0
 #define ONE_WIRE_BUS_STATE_TERMINATED	1
@@ -43,6 +46,9 @@
 #define ONE_WIRE_BUS_MEMBER_MASTER	0
 #define ONE_WIRE_BUS_MEMBER_SLAVE	1
 
+/* The bus coroutine itself needs very little stack. */
+#define ONE_WIRE_BUS_STACK_SIZE		16384
+
 struct one_wire_bus;
 
 typedef void (*bus_device_driver_t)(void *);
@@ -53,9 +59,18 @@ struct one_wire_bus_member
 	struct coroutine     coro;
 	struct one_wire_bus *bus;
 	struct list_head     list_entry;
+	struct list_head     access_entry;	/* On ready, pending or parked. */
 	int	             bus_access;
+	int                  status;
+	const uint8_t *      tx;
+	uint8_t *            rx;
+	size_t               bits;
+	size_t               offset;
+	uint8_t              tx_buf;
+	uint8_t              rx_buf;
 	void *               device;
 	bus_device_driver_t  driver;
+	size_t               stack_size;	/* 0 is the default. */
 #ifdef DEBUG
 	char                 name[16];
 #endif
@@ -63,8 +78,12 @@ struct one_wire_bus_member
 
 struct one_wire_bus
 {
+	struct coroutine_scheduler *sched;
 	int              state;
 	struct list_head members;
+	struct list_head ready;		/* To run until they access the bus. */
+	struct list_head pending;	/* Transfers and resets to resolve.  */
+	struct list_head parked;	/* Waiting for a reset pulse.         */
 	struct coroutine coro;
 	int              signal;
 #ifdef DEBUG
@@ -76,7 +95,7 @@ struct one_wire_bus
 extern "C" {
 #endif
 
-void one_wire_bus_init(struct one_wire_bus *bus);
+void one_wire_bus_init(struct one_wire_bus *bus, struct coroutine_scheduler *);
 int  one_wire_bus_run(struct one_wire_bus *bus);
 
 void one_wire_bus_member_init(struct one_wire_bus_member *member);
@@ -86,10 +105,14 @@ void one_wire_bus_member_remove(struct one_wire_bus_member *);
 void one_wire_bus_member_master_set(struct one_wire_bus_member *member);
 
 void one_wire_bus_member_reset_pulse(struct one_wire_bus_member *);
+int  one_wire_bus_member_reset_wait(struct one_wire_bus_member *);
 int  one_wire_bus_member_tx_bit(struct one_wire_bus_member *, int);
 int  one_wire_bus_member_rx_bit(struct one_wire_bus_member *);
 int  one_wire_bus_member_rx_byte(struct one_wire_bus_member *);
 int  one_wire_bus_member_tx_byte(struct one_wire_bus_member *, int);
+int  one_wire_bus_member_tx_block(struct one_wire_bus_member *,
+                                  const uint8_t *, uint8_t *, size_t);
+int  one_wire_bus_member_tx_pattern(struct one_wire_bus_member *, int, size_t);
 
 void one_wire_bus_member_write_bit(struct one_wire_bus_member *member, int bit);
 void one_wire_bus_member_write_byte(struct one_wire_bus_member *member, int byte);
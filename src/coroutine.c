@@ -24,9 +24,13 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  */
+#include <sys/mman.h>
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ucontext.h>
+#include <unistd.h>
 #include "coroutine.h"
 #include "debug.h"
 #include "list.h"
@@ -35,38 +39,271 @@
 #include <valgrind/valgrind.h>
 #endif
 
-static size_t stack_size = 65536;
-static ucontext_t main_context;
-static ucontext_t cleanup_context;
-static struct coroutine *coro_current;
-static struct list_head active_list = LIST_HEAD_INIT(active_list);
+/* Coroutine stacks are mapped with a guard page below them, so running
+ * off the end faults instead of corrupting whatever is mapped there.
+ * While a stack is in the pool of its scheduler, its lowest bytes hold
+ * this structure.
+ */
+struct coroutine_stack
+{
+	struct list_head	entry;
+	size_t			size;
+};
 
-int coroutine_init(struct coroutine *coro, coroutine_handler_t f, void *cookie)
+static size_t
+__coroutine_page_size(void)
 {
-	unsigned char *stack;
+	static size_t page_size;
+
+	if (page_size == 0)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	return page_size;
+}
+
+static size_t
+__coroutine_stack_size(size_t size)
+{
+	size_t page_size = __coroutine_page_size();
+
+	if (size == 0)
+		size = COROUTINE_STACK_SIZE_DEFAULT;
+
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+static void *
+__coroutine_stack_map(size_t size)
+{
+	size_t page_size = __coroutine_page_size();
+	unsigned char *base;
+
+	base = mmap(NULL, size + page_size, PROT_READ | PROT_WRITE,
+	            MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	if (mprotect(base, page_size, PROT_NONE) == -1) {
+		munmap(base, size + page_size);
+		return NULL;
+	}
+
+	return base + page_size;
+}
+
+static void
+__coroutine_stack_unmap(void *stack, size_t size)
+{
+	size_t page_size = __coroutine_page_size();
+
+	munmap((unsigned char *)stack - page_size, size + page_size);
+}
+
+/* Take a stack of 'size' bytes from the pool, or map a new one. */
+static void *
+__coroutine_stack_get(struct coroutine_scheduler *sched, size_t size)
+{
+	struct list_head *lh;
+
+	list_for_each (lh, &sched->stack_pool) {
+		struct coroutine_stack *stack =
+			list_entry(lh, struct coroutine_stack, entry);
+
+		if (stack->size == size) {
+			list_del(&stack->entry);
+			return stack;
+		}
+	}
+
+	return __coroutine_stack_map(size);
+}
+
+static void
+__coroutine_stack_put(struct coroutine_scheduler *sched,
+                      void *stack, size_t size)
+{
+	struct coroutine_stack *s = (struct coroutine_stack *)stack;
+
+	s->size = size;
+	list_add(&s->entry, &sched->stack_pool);
+}
+
+#ifdef HAVE_COROUTINE_ASM
+/* Implemented in coroutine-<arch>.S.  __coroutine_switch() saves the
+ * callee-saved registers on the current stack, stores the stack pointer
+ * in 'from', and restores the registers saved on the stack at 'to'.
+ * __coroutine_trampoline() is where a new context starts, and calls the
+ * function in its initial frame with the coroutine as argument.
+ */
+void __coroutine_switch(void **from, void *to);
+void __coroutine_trampoline(void);
+#endif
+
+static void
+__coroutine_entry(struct coroutine *coro)
+{
+	coro->handler(coro);
+
+	/* Switch to the main context of the scheduler ourselves, as that
+	 * is only known once it runs.  We never come back.
+	 */
+#ifdef HAVE_COROUTINE_ASM
+	__coroutine_switch(&coro->context.sp, coro->sched->main_context.sp);
+#else
+	setcontext(coro->sched->main_context.sp);
+#endif
+}
+
+static int
+__coroutine_context_init(struct coroutine *coro, void *stack, size_t size)
+{
+	uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#ifdef HAVE_COROUTINE_ASM
+	void **frame;
 
-	if (getcontext(&coro->context) == -1)
+	/* Build the frame __coroutine_switch() pops the first time we
+	 * switch to this coroutine, returning into the trampoline with the
+	 * coroutine and __coroutine_entry() in callee-saved registers.
+	 */
+#if defined(__x86_64__)
+	/* r15, r14, r13, r12, rbx, rbp and the return address.  The stack
+	 * is 16 byte aligned after returning into the trampoline.
+	 */
+	frame = (void **)(top - 9 * sizeof(void *));
+	memset(frame, 0, 9 * sizeof(void *));
+	frame[2] = coro;
+	frame[3] = (void *)__coroutine_entry;
+	frame[6] = (void *)__coroutine_trampoline;
+#elif defined(__aarch64__)
+	/* x19-x28, x29, x30 and d8-d15. */
+	frame = (void **)(top - 20 * sizeof(void *));
+	memset(frame, 0, 20 * sizeof(void *));
+	frame[0]  = coro;
+	frame[1]  = (void *)__coroutine_entry;
+	frame[11] = (void *)__coroutine_trampoline;
+#else
+#error "HAVE_COROUTINE_ASM is not supported on this architecture."
+#endif
+	coro->context.sp = frame;
+#else
+	/* The ucontext_t lives at the top of the stack, and the coroutine
+	 * runs on the part below it.  This way snapshots of the stack also
+	 * hold the context.
+	 */
+	ucontext_t *uc = (ucontext_t *)((top - sizeof *uc) & ~(uintptr_t)15);
+
+	if (getcontext(uc) == -1)
 		return -1;
 
-	if ( (stack = malloc(stack_size)) == NULL)
+	uc->uc_link           = NULL;
+	uc->uc_stack.ss_sp    = stack;
+	uc->uc_stack.ss_size  = (unsigned char *)uc - (unsigned char *)stack;
+	uc->uc_stack.ss_flags = 0;
+	makecontext(uc, (void (*)())__coroutine_entry, 1, coro);
+	coro->context.sp = uc;
+#endif
+	return 0;
+}
+
+static inline int
+__coroutine_context_switch(coroutine_context_t *from, coroutine_context_t *to)
+{
+#ifdef HAVE_COROUTINE_ASM
+	__coroutine_switch(&from->sp, to->sp);
+	return 0;
+#else
+	return swapcontext(from->sp, to->sp);
+#endif
+}
+
+void
+coroutine_scheduler_init(struct coroutine_scheduler *sched)
+{
+	memset(sched, 0, sizeof *sched);
+	list_init(&sched->active_list);
+	list_init(&sched->stack_pool);
+}
+
+/* Unmap all pooled stacks.  The scheduler should not be running. */
+void
+coroutine_scheduler_destroy(struct coroutine_scheduler *sched)
+{
+	struct list_head *lh, *lh2;
+
+	list_for_each_safe (lh, lh2, &sched->stack_pool) {
+		struct coroutine_stack *stack =
+			list_entry(lh, struct coroutine_stack, entry);
+
+		list_del(&stack->entry);
+		__coroutine_stack_unmap(stack, stack->size);
+	}
+}
+
+/* Put 'count' stacks of 'size' bytes in the pool, faulting in all their
+ * pages up front.  A size of 0 is the default stack size.
+ */
+int
+coroutine_scheduler_stack_reserve(struct coroutine_scheduler *sched,
+                                  size_t size, size_t count)
+{
+	size_t page_size = __coroutine_page_size();
+	unsigned char *stack;
+
+	size = __coroutine_stack_size(size);
+
+	while (count-- > 0) {
+		if ( (stack = __coroutine_stack_map(size)) == NULL)
+			return -1;
+
+		for (size_t i = 0; i < size; i += page_size)
+			((volatile unsigned char *)stack)[i] = 0;
+
+		__coroutine_stack_put(sched, stack, size);
+	}
+
+	return 0;
+}
+
+int coroutine_init(struct coroutine *coro, struct coroutine_scheduler *sched,
+                   coroutine_handler_t f, void *cookie)
+{
+	return coroutine_init_stack(coro, sched, f, cookie, 0);
+}
+
+/* Like coroutine_init(), but with a stack of 'stack_size' bytes instead of
+ * the default.  The size is rounded up to whole pages.
+ */
+int coroutine_init_stack(struct coroutine *coro,
+                         struct coroutine_scheduler *sched,
+                         coroutine_handler_t f, void *cookie,
+                         size_t stack_size)
+{
+	unsigned char *stack;
+
+	stack_size = __coroutine_stack_size(stack_size);
+	if ( (stack = __coroutine_stack_get(sched, stack_size)) == NULL)
 		return -1;
 
+	coro->sched                     = sched;
+	coro->handler                   = f;
 	coro->destructor                = NULL;
 	coro->cookie                    = cookie;
 	coro->data			= NULL;
-	coro->context.uc_link           = &cleanup_context;
-	coro->context.uc_stack.ss_sp    = stack;
-	coro->context.uc_stack.ss_size  = stack_size;
-	coro->context.uc_stack.ss_flags = 0;
-	list_add_tail(&coro->entry, &active_list);
+	coro->stack			= stack;
+	coro->stack_size		= stack_size;
+
+	if (__coroutine_context_init(coro, stack, stack_size) == -1) {
+		__coroutine_stack_put(sched, stack, stack_size);
+		return -1;
+	}
+
+	list_add_tail(&coro->entry, &sched->active_list);
 	list_init(&coro->yield_list);
 
 #ifdef DEBUG
 	coro->stack_id = VALGRIND_STACK_REGISTER(stack, stack + stack_size);
 #endif
 
-	makecontext(&coro->context, (void (*)())f, 1, coro);
-
 	return 0;
 }
 
@@ -78,9 +315,9 @@ coroutine_destructor_set(struct coroutine *coro, coroutine_destructor_t d)
 
 void coroutine_reschedule(struct coroutine *coro)
 {
-	coro_current = coro;
+	coro->sched->current = coro;
 	list_del(&coro->entry);
-	list_add_tail(&coro->entry, &active_list);
+	list_add_tail(&coro->entry, &coro->sched->active_list);
 }
 
 void *coroutine_await(struct coroutine *coro, struct coroutine *other)
@@ -97,7 +334,7 @@ void *coroutine_await(struct coroutine *coro, struct coroutine *other)
 	list_add_tail(&coro->entry, &other->yield_list);
 
 	coroutine_reschedule(other);
-	if (swapcontext(&coro->context, &other->context) == -1)
+	if (__coroutine_context_switch(&coro->context, &other->context) == -1)
 		return NULL;
 
 	/* Take it from the yield list and reschedule. */
@@ -109,13 +346,14 @@ void *coroutine_await(struct coroutine *coro, struct coroutine *other)
 /* Yield to an arbitrary other coroutine. */
 int coroutine_yield(struct coroutine *coro)
 {
+	struct coroutine_scheduler *sched = coro->sched;
 	struct coroutine *other;
 
 	/* Nothing to reschedule to, so we're done. */
-	if (list_empty(&active_list))
+	if (list_empty(&sched->active_list))
 		return 0;
 
-	other = list_entry(active_list.next, struct coroutine, entry);
+	other = list_entry(sched->active_list.next, struct coroutine, entry);
 	return coroutine_yieldto(coro, other);
 }
 
@@ -126,7 +364,7 @@ int coroutine_yieldto(struct coroutine *coro, struct coroutine *other)
 	assert(other != NULL);
 
 	coroutine_reschedule(other);
-	if (swapcontext(&coro->context, &other->context) == -1)
+	if (__coroutine_context_switch(&coro->context, &other->context) == -1)
 		return -1;
 
 	return 0;
@@ -147,7 +385,7 @@ int coroutine_return(struct coroutine *coro, void *data)
 
 	/* Remove the selected coroutine from the yield list. */
 	list_del(&other->entry);
-	list_add_tail(&other->entry, &active_list);
+	list_add_tail(&other->entry, &coro->sched->active_list);
 
 	return coroutine_returnto(coro, other, data);
 }
@@ -158,7 +396,7 @@ int coroutine_returnto(struct coroutine *coro, struct coroutine *other, void *da
 	coro->data = data;
 
 	coroutine_reschedule(other);
-	if (swapcontext(&coro->context, &other->context) == -1)
+	if (__coroutine_context_switch(&coro->context, &other->context) == -1)
 		return -1;
 
 	return 0;
@@ -170,58 +408,152 @@ void coroutine_destroy(struct coroutine *coro)
 	VALGRIND_STACK_DEREGISTER(coro->stack_id);
 #endif
 	list_del(&coro->entry);
-	free(coro->context.uc_stack.ss_sp);
+	__coroutine_stack_put(coro->sched, coro->stack, coro->stack_size);
 }
 
-void coroutine_end(void)
+void coroutine_end(struct coroutine_scheduler *sched)
 {
-	if (coro_current->destructor != NULL)
-		coro_current->destructor(coro_current);
+	struct coroutine *coro = sched->current;
 
-	coroutine_destroy(coro_current);
+	if (coro->destructor != NULL)
+		coro->destructor(coro);
+
+	coroutine_destroy(coro);
 }
 
-int coroutine_main(void)
+/* Returns 0 when all coroutines have ended, and 1 when one of them has
+ * stopped the scheduler.
+ */
+int coroutine_scheduler_run(struct coroutine_scheduler *sched)
 {
-	static unsigned char stack[65536];
 	struct coroutine *coro;
-	int id;
-
-	/* This is the place where we store and will return to the main
-	 * context once the active_list is empty.  We cannoy modify the
-	 * context after we set it in the uc_link of another context which
-	 * we then makecontext(), so this has to be done here.
-	 */
-	getcontext(&main_context);
-	if (list_empty(&active_list))
-		return 0;
+#ifndef HAVE_COROUTINE_ASM
+	ucontext_t main_uc;
 
-	getcontext(&cleanup_context);
-	cleanup_context.uc_link           = &main_context;
-	cleanup_context.uc_stack.ss_sp    = stack;
-	cleanup_context.uc_stack.ss_size  = sizeof(stack);
-	cleanup_context.uc_stack.ss_flags = 0;
-#ifdef DEBUG
-	id = VALGRIND_STACK_REGISTER(stack, stack + sizeof stack);
+	/* Coroutines only switch to the main context while we run. */
+	sched->main_context.sp = &main_uc;
 #endif
-	makecontext(&cleanup_context, coroutine_end, 0);
 
-	/* Main loop; this is only relevant when coroutine_end is called,
-	 * as that is the only way we will reenter the cleanup_context above.
+	/* Run coroutines until the active_list is empty.  We only get back
+	 * in the main context when a coroutine has ended, at which point we
+	 * clean it up from here, as it cannot free the stack it runs on, or
+	 * when it has stopped the scheduler, and we continue it next time.
 	 */
-	if (!list_empty(&active_list)) {
-		coro = list_entry(active_list.next, struct coroutine, entry);
+	while (!list_empty(&sched->active_list)) {
+		if (sched->stopped)
+			coro = sched->current;
+		else
+			coro = list_entry(sched->active_list.next,
+			                  struct coroutine, entry);
+
+		sched->stopped = 0;
 		coroutine_reschedule(coro);
-		setcontext(&coro->context);
+
+		if (__coroutine_context_switch(&sched->main_context,
+		                               &coro->context) == -1)
+			return -1;
+
+		if (sched->stopped)
+			return 1;
+
+		coroutine_end(sched);
 	}
 
-#ifdef DEBUG
-	VALGRIND_STACK_DEREGISTER(id);
+	return 0;
+}
+
+/* Suspend the scheduler 'coro' runs on, and return from
+ * coroutine_scheduler_run() in the main context.  The next run of the
+ * scheduler continues with 'coro', for which this call then returns.
+ */
+int coroutine_scheduler_stop(struct coroutine *coro)
+{
+	struct coroutine_scheduler *sched = coro->sched;
+
+	assert(sched->current == coro);
+
+	sched->stopped = 1;
+	return __coroutine_context_switch(&coro->context, &sched->main_context);
+}
+
+static size_t
+__coroutine_stack_used(const struct coroutine *coro)
+{
+#ifdef HAVE_COROUTINE_ASM
+	/* Nothing below the saved stack pointer is live. */
+	return (unsigned char *)coro->stack + coro->stack_size -
+	       (unsigned char *)coro->context.sp;
+#else
+	/* We cannot tell where ucontext keeps the stack pointer. */
+	return coro->stack_size;
 #endif
+}
+
+/* The snapshot has room for the whole stack of 'coro', so taking it never
+ * allocates.
+ */
+int
+coroutine_snapshot_init(struct coroutine_snapshot *snap, struct coroutine *coro)
+{
+	if ( (snap->stack = malloc(coro->stack_size)) == NULL)
+		return -1;
+
+	snap->coro = coro;
+	snap->used = 0;
+
 	return 0;
 }
 
+/* Snapshots can only be taken and restored while the scheduler of the
+ * coroutine is not running, or has been stopped.
+ */
+void
+coroutine_snapshot_take(struct coroutine_snapshot *snap)
+{
+	struct coroutine *coro = snap->coro;
+	unsigned char *top = (unsigned char *)coro->stack + coro->stack_size;
+
+	snap->saved = *coro;
+	snap->used  = __coroutine_stack_used(coro);
+	memcpy(snap->stack, top - snap->used, snap->used);
+}
+
+void
+coroutine_snapshot_restore(struct coroutine_snapshot *snap)
+{
+	struct coroutine *coro = &snap->saved;
+	unsigned char *top = (unsigned char *)coro->stack + coro->stack_size;
+	struct list_head *lh;
+
+	/* If the coroutine has ended since, its stack is back in the pool
+	 * and we take it out again.  Nothing else can have used it yet.
+	 */
+	list_for_each (lh, &coro->sched->stack_pool) {
+		struct coroutine_stack *stack =
+			list_entry(lh, struct coroutine_stack, entry);
+
+		if ((void *)stack == coro->stack) {
+			list_del(&stack->entry);
+#ifdef DEBUG
+			coro->stack_id = VALGRIND_STACK_REGISTER(coro->stack,
+			                                         top);
+#endif
+			break;
+		}
+	}
+
+	memcpy(top - snap->used, snap->stack, snap->used);
+	*snap->coro = *coro;
+}
+
+void
+coroutine_snapshot_destroy(struct coroutine_snapshot *snap)
+{
+	free(snap->stack);
+}
+
 #ifdef TEST
+struct coroutine_scheduler sched;
 struct coroutine coro_f;
 struct coroutine coro_g;
 struct coroutine coro_h;
@@ -245,10 +577,7 @@ void g(struct coroutine *coro)
 	int i;
 
 	printf("coroutine g\n");
-	printf("g: main: %p\n", &main_context);
-	printf("g: main.uc_link: %p\n", main_context.uc_link);
-	printf("g: cleanup: %p\n", &cleanup_context);
-	printf("g: link: %p\n", coro->context.uc_link);
+	printf("g: main: %p\n", &coro->sched->main_context);
 
 	coroutine_return(coro, NULL);
 }
@@ -267,11 +596,12 @@ void h(struct coroutine *coro)
 
 int main(void)
 {
-	coroutine_init(&coro_f, f, 0x41414141);
-	coroutine_init(&coro_g, g, NULL);
-	coroutine_init(&coro_h, h, NULL);
+	coroutine_scheduler_init(&sched);
+	coroutine_init(&coro_f, &sched, f, 0x41414141);
+	coroutine_init(&coro_g, &sched, g, NULL);
+	coroutine_init(&coro_h, &sched, h, NULL);
 
-	coroutine_main();
+	coroutine_scheduler_run(&sched);
 	printf("back in main()\n");
 }
 #endif
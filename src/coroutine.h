@@ -27,33 +27,90 @@
 #ifndef COROUTINE_H
 #define COROUTINE_H
 
-#include <ucontext.h>
+#include <stddef.h>
 #include "debug.h"
 #include "list.h"
 
+/* The stack size coroutines get when they do not ask for one. */
+#define COROUTINE_STACK_SIZE_DEFAULT	65536
+
 struct coroutine;
+struct coroutine_scheduler;
 
 typedef void (*coroutine_handler_t)(struct coroutine *);
 typedef void (*coroutine_destructor_t)(struct coroutine *);
 
+/* With HAVE_COROUTINE_ASM a context is just the saved stack pointer, as
+ * the callee-saved registers live on the stack of the coroutine itself.
+ * Without it 'sp' points at a ucontext_t kept on that stack instead, so the
+ * layout of everything embedding a coroutine does not depend on how the
+ * library was built.
+ */
+typedef struct {
+	void			*sp;
+} coroutine_context_t;
+
 struct coroutine
 {
+	struct coroutine_scheduler *sched;
+	coroutine_handler_t	handler;
 	coroutine_destructor_t	destructor;
 	void			*cookie;
 	void			*data;
+	void			*stack;
+	size_t			stack_size;
 	struct list_head	entry;
 	struct list_head	yield_list;
-	ucontext_t		context;
+	coroutine_context_t	context;
 #ifdef DEBUG
 	int			stack_id;
 #endif
 };
 
+/* A scheduler owns a set of coroutines and runs them on the thread that
+ * calls coroutine_scheduler_run().  Coroutines only ever switch to other
+ * coroutines of the same scheduler, so independent schedulers can run on
+ * separate threads.
+ *
+ * The stacks of destroyed coroutines are kept in 'stack_pool' to be
+ * handed out again, so they are never shared between threads either.
+ */
+struct coroutine_scheduler
+{
+	struct list_head	active_list;
+	struct list_head	stack_pool;
+	struct coroutine	*current;
+	int			stopped;
+	coroutine_context_t	main_context;
+};
+
+/* A copy of a suspended coroutine, and of the part of its stack in use.
+ * Restoring it puts the coroutine back in the state it was in when the
+ * snapshot was taken, even if it has ended since.
+ */
+struct coroutine_snapshot
+{
+	struct coroutine	*coro;
+	struct coroutine	saved;
+	unsigned char		*stack;
+	size_t			used;
+};
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-int   coroutine_init(struct coroutine *, coroutine_handler_t, void *);
+void  coroutine_scheduler_init(struct coroutine_scheduler *);
+void  coroutine_scheduler_destroy(struct coroutine_scheduler *);
+int   coroutine_scheduler_run(struct coroutine_scheduler *);
+int   coroutine_scheduler_stack_reserve(struct coroutine_scheduler *,
+                                        size_t, size_t);
+int   coroutine_scheduler_stop(struct coroutine *);
+
+int   coroutine_init(struct coroutine *, struct coroutine_scheduler *,
+                     coroutine_handler_t, void *);
+int   coroutine_init_stack(struct coroutine *, struct coroutine_scheduler *,
+                           coroutine_handler_t, void *, size_t);
 void  coroutine_destructor_set(struct coroutine *, coroutine_destructor_t);
 void *coroutine_await(struct coroutine *, struct coroutine *);
 int   coroutine_return(struct coroutine *, void *);
@@ -62,7 +119,10 @@ int   coroutine_yieldto(struct coroutine *, struct coroutine *);
 int   coroutine_yield(struct coroutine *);
 void  coroutine_destroy(struct coroutine *);
 
-int   coroutine_main(void);
+int   coroutine_snapshot_init(struct coroutine_snapshot *, struct coroutine *);
+void  coroutine_snapshot_take(struct coroutine_snapshot *);
+void  coroutine_snapshot_restore(struct coroutine_snapshot *);
+void  coroutine_snapshot_destroy(struct coroutine_snapshot *);
 
 #ifdef __cplusplus
 };
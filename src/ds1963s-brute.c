@@ -0,0 +1,655 @@
+/* ds1963s-brute.c
+ *
+ * Recover DS1963S secrets from HMAC links obtained by partial overwrites.
+ *
+ * Every secret is recovered as a chain of links.  Link n is the HMAC of the
+ * secret with its first n * width bytes overwritten by zeroes, so starting
+ * at the last link every link leaves at most 'width' unknown bytes, given
+ * the bytes recovered by the link after it.  The default width of 2 gives
+ * 4 links of 65536 candidates.  Secrets marked as 'tail' are mirrored:
+ * their links overwrite the last n * width bytes instead.  Links of a
+ * single chain depend on each other, but the 8 chains are independent,
+ * and so is every candidate within a link.  We hand out chunks of
+ * candidates from all chains to a pool of worker threads.
+ *
+ * Chains of several devices can be recovered in one run.  Chunks are
+ * handed out from the first chain that has any left, so devices finish
+ * roughly in order, while workers never wait for the last chunks of a link
+ * as long as there is another chain to work on.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2013-2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ds1963s-brute.h"
+#include "getput.h"
+#include "sha1.h"
+#include "sha1-mb.h"
+
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
+
+/* Number of candidates handed to a worker at once.  This is small enough
+ * to spread the last link of a chain over all workers, and large enough
+ * to keep contention on the engine lock negligible.
+ */
+#define BRUTE_CHUNK_SIZE	4096
+
+/* Number of candidates hashed in one go by the multi-buffer kernel.  A
+ * worker checks whether another worker already found the link it is
+ * working on after every batch.
+ */
+#define BRUTE_BATCH_SIZE	256
+
+/* Number of candidates tested to measure the hash rate. */
+#define BRUTE_RATE_CANDIDATES	(1 << 20)
+
+struct brute_chain
+{
+	struct ds1963s_brute	*brute;
+	size_t			index;		/* Index of the device.           */
+	int			secret;
+	int			link;		/* Link under attack, -1 if done. */
+	uint64_t		space;		/* Candidates in the link.        */
+	uint64_t		next;		/* Next candidate to hand out.    */
+	int			pending;	/* Chunks of the link in flight.  */
+	int			found;
+};
+
+struct brute_engine
+{
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct brute_chain	*chains;
+	size_t			chain_count;
+	size_t			chains_done;
+	size_t			chain_first;	/* No work before this chain.     */
+	int			*remaining;	/* Chains left per device.        */
+	ds1963s_brute_done_t	done;
+	void			*done_arg;
+};
+
+struct brute_worker
+{
+	pthread_t		thread;
+	struct brute_engine	*engine;
+	struct ds1963s_device	dev;
+	uint64_t		hashes;
+	double			elapsed;
+};
+
+static double
+__timespec_diff(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Return the number of unknown bytes in 'link'. */
+static int
+__brute_link_bytes(struct ds1963s_brute *brute, int link)
+{
+	return MIN(brute->width, 8 - link * brute->width);
+}
+
+static uint64_t
+__brute_link_space(struct ds1963s_brute *brute, int link)
+{
+	return 1ULL << (8 * __brute_link_bytes(brute, link));
+}
+
+/* Secret bytes 0-3 end up in word 0 of the SHA-1 input block, and bytes
+ * 4-7 in word 12.  Byte 'i' is at the given shift within its word.
+ */
+#define BRUTE_BYTE_WORD(i)	((i) < 4 ? 0 : 12)
+#define BRUTE_BYTE_SHIFT(i)	(24 - 8 * ((i) % 4))
+
+/* Map position 'i' in the link chain of a secret to its byte index. */
+#define BRUTE_BYTE(s, i)	((s)->tail ? 7 - (i) : (i))
+
+/* Determine the order in which the bytes of 'link' are taken from the
+ * candidate number, lowest first.  The multi-buffer kernel varies a single
+ * word, so the bytes in the word of the last byte come first.  A link of
+ * 3 bytes can straddle both words, and the remaining bytes change only
+ * every 'inner' bytes worth of candidates.  Returns the word varied.
+ */
+static int
+__brute_link_layout(struct ds1963s_brute *brute, int secret, int link,
+                    int order[4], int *inner)
+{
+	struct ds1963s_brute_secret *secret_state = &brute->secrets[secret];
+	int first = link * brute->width;
+	int count = __brute_link_bytes(brute, link);
+	int i, n, word;
+
+	word = BRUTE_BYTE_WORD(BRUTE_BYTE(secret_state, first + count - 1));
+
+	for (i = first, n = 0; i < first + count; i++)
+		if (BRUTE_BYTE_WORD(BRUTE_BYTE(secret_state, i)) == word)
+			order[n++] = BRUTE_BYTE(secret_state, i);
+	*inner = n;
+
+	for (i = first; i < first + count; i++)
+		if (BRUTE_BYTE_WORD(BRUTE_BYTE(secret_state, i)) != word)
+			order[n++] = BRUTE_BYTE(secret_state, i);
+
+	return word;
+}
+
+/* Prepare the secret in 'dev' for an attack on 'link'.  The bytes before
+ * the link have been overwritten with zeroes, and the bytes after it have
+ * been recovered from the previous link.
+ */
+static void
+__brute_link_setup(struct ds1963s_device *dev, struct ds1963s_brute *brute,
+                   int secret, int link)
+{
+	struct ds1963s_brute_secret *secret_state = &brute->secrets[secret];
+	int first = link * brute->width;
+
+	memset(&dev->secret_memory[secret * 8], 0, 8);
+	for (int i = first; i < 8; i++) {
+		int byte = BRUTE_BYTE(secret_state, i);
+
+		dev->secret_memory[secret * 8 + byte] =
+			secret_state->secret[byte];
+	}
+}
+
+/* Test the candidates [start, end) for 'link' of 'secret' using the device
+ * model 'dev'.  Returns 0 and stores the matching candidate in 'result' if
+ * it was found, and -1 otherwise.  We stop early when '*cancel' is set.
+ *
+ * The candidate bytes change word 0 of the SHA-1 input block for secret
+ * bytes 0-3, and word 12 for bytes 4-7.  We build the block once for every
+ * value of the bytes outside the varied word, precompute everything that
+ * does not depend on that word, and let the multi-buffer kernel vary it.
+ */
+static int
+__brute_range(struct ds1963s_device *dev, struct ds1963s_brute *brute,
+              int secret, int link, uint64_t start, uint64_t end,
+              int *cancel, uint64_t *result, uint64_t *hashes)
+{
+	struct ds1963s_brute_secret *secret_state = &brute->secrets[secret];
+	uint32_t values[BRUTE_BATCH_SIZE];
+	struct sha1_mb_search search;
+	uint32_t base[16], block[16], target[5];
+	int count, inner, k, order[4], word;
+	uint64_t c, outer, outer_last, n;
+	size_t index;
+	uint32_t j;
+
+	ds1963s_dev_read_auth_page_input(dev, secret, base);
+
+	/* The scratchpad holds E, D, C, B, A in little-endian order. */
+	for (k = 0; k < 5; k++)
+		target[k] = GET_32BIT_LSB(&secret_state->target_hmac[link][16 - k * 4]);
+
+	word  = __brute_link_layout(brute, secret, link, order, &inner);
+	count = __brute_link_bytes(brute, link);
+
+	for (k = 0; k < count; k++) {
+		base[BRUTE_BYTE_WORD(order[k])] &=
+			~(0xFFU << BRUTE_BYTE_SHIFT(order[k]));
+	}
+
+	outer_last = UINT64_MAX;
+	for (c = start; c < end; c += n) {
+		if (cancel != NULL && __atomic_load_n(cancel, __ATOMIC_RELAXED))
+			break;
+
+		/* Bytes outside the varied word change rarely, and need new
+		 * precomputed state.
+		 */
+		outer = c >> (8 * inner);
+		if (outer != outer_last) {
+			memcpy(block, base, sizeof block);
+			for (k = inner; k < count; k++) {
+				uint32_t v = (outer >> (8 * (k - inner))) & 0xFF;
+
+				block[BRUTE_BYTE_WORD(order[k])] |=
+					v << BRUTE_BYTE_SHIFT(order[k]);
+			}
+
+			sha1_mb_search_init(&search, block, word);
+			sha1_mb_search_target(&search, target);
+			outer_last = outer;
+		}
+
+		n = MIN(end - c, BRUTE_BATCH_SIZE);
+		n = MIN(n, ((outer + 1) << (8 * inner)) - c);
+		for (j = 0; j < n; j++) {
+			values[j] = block[word];
+			for (k = 0; k < inner; k++) {
+				uint32_t v = ((c + j) >> (8 * k)) & 0xFF;
+
+				values[j] |= v << BRUTE_BYTE_SHIFT(order[k]);
+			}
+		}
+
+		*hashes += n;
+		if (sha1_mb_search_find(&search, values, n, &index) == 0) {
+			*result = c + index;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static void
+__brute_link_found(struct ds1963s_brute *brute, int secret, int link,
+                   uint64_t candidate)
+{
+	struct ds1963s_brute_secret *secret_state = &brute->secrets[secret];
+	int count, inner, k, order[4];
+
+	__brute_link_layout(brute, secret, link, order, &inner);
+	count = __brute_link_bytes(brute, link);
+
+	for (k = 0; k < count; k++)
+		secret_state->secret[order[k]] = (candidate >> (8 * k)) & 0xFF;
+}
+
+/* Find the first chain that still has candidates to hand out.  Must be
+ * called with the engine lock held.
+ */
+static struct brute_chain *
+__brute_chain_next(struct brute_engine *engine)
+{
+	struct brute_chain *chain;
+	size_t i;
+
+	while (engine->chain_first < engine->chain_count &&
+	       engine->chains[engine->chain_first].link == -1)
+		engine->chain_first++;
+
+	for (i = engine->chain_first; i < engine->chain_count; i++) {
+		chain = &engine->chains[i];
+		if (chain->link == -1 || chain->found)
+			continue;
+
+		if (chain->next == chain->space)
+			continue;
+
+		return chain;
+	}
+
+	return NULL;
+}
+
+/* Move the chain to its next link once all chunks of the current link
+ * are done, and report the device once all its chains are done.  Must be
+ * called with the engine lock held.
+ */
+static void
+__brute_chain_advance(struct brute_engine *engine, struct brute_chain *chain)
+{
+	struct ds1963s_brute_secret *secret_state;
+
+	if (chain->pending != 0)
+		return;
+
+	if (!chain->found && chain->next != chain->space)
+		return;
+
+	secret_state = &chain->brute->secrets[chain->secret];
+
+	if (!chain->found) {
+		secret_state->state = DS1963S_BRUTE_SECRET_FAILED;
+		chain->link = -1;
+	} else if (--chain->link == -1) {
+		secret_state->state = DS1963S_BRUTE_SECRET_FOUND;
+	} else {
+		chain->space = __brute_link_space(chain->brute, chain->link);
+		chain->next  = 0;
+		chain->found = 0;
+	}
+
+	if (chain->link == -1) {
+		engine->chains_done++;
+
+		if (--engine->remaining[chain->index] == 0 && engine->done)
+			engine->done(chain->index, chain->brute, engine->done_arg);
+	}
+
+	pthread_cond_broadcast(&engine->cond);
+}
+
+static void *
+__brute_worker(void *arg)
+{
+	struct brute_worker *worker = (struct brute_worker *)arg;
+	struct brute_engine *engine = worker->engine;
+	struct timespec start_time, end_time;
+	struct brute_chain *chain;
+	uint64_t start, end, result;
+	int link, ret;
+
+	pthread_mutex_lock(&engine->lock);
+	while (engine->chains_done != engine->chain_count) {
+		if ( (chain = __brute_chain_next(engine)) == NULL) {
+			pthread_cond_wait(&engine->cond, &engine->lock);
+			continue;
+		}
+
+		link  = chain->link;
+		start = chain->next;
+		end   = MIN(start + BRUTE_CHUNK_SIZE, chain->space);
+		chain->next = end;
+		chain->pending++;
+		pthread_mutex_unlock(&engine->lock);
+
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+		memcpy(&worker->dev, &chain->brute->dev, sizeof worker->dev);
+		__brute_link_setup(&worker->dev, chain->brute, chain->secret, link);
+		ret = __brute_range(&worker->dev, chain->brute, chain->secret,
+		                    link, start, end, &chain->found, &result,
+		                    &worker->hashes);
+		clock_gettime(CLOCK_MONOTONIC, &end_time);
+		worker->elapsed += __timespec_diff(&start_time, &end_time);
+
+		pthread_mutex_lock(&engine->lock);
+		chain->pending--;
+		if (ret == 0 && !chain->found) {
+			__brute_link_found(chain->brute, chain->secret, link, result);
+			__atomic_store_n(&chain->found, 1, __ATOMIC_RELAXED);
+		}
+		__brute_chain_advance(engine, chain);
+	}
+	pthread_mutex_unlock(&engine->lock);
+
+	return NULL;
+}
+
+static void
+__brute_report(struct brute_worker *workers, int jobs)
+{
+	const struct sha1_mb_kernel *kernel = sha1_mb_kernel_get();
+	uint64_t hashes = 0;
+	double rate = 0;
+
+	fprintf(stderr, "    SHA-1    : %s kernel, %d lane(s), %s verify\n",
+	        kernel->name, kernel->lanes, ds1963s_sha1_compress_raw_name());
+
+	for (int i = 0; i < jobs; i++) {
+		double r = 0;
+
+		if (workers[i].elapsed > 0)
+			r = workers[i].hashes / workers[i].elapsed;
+
+		fprintf(stderr, "    Thread #%d: %" PRIu64 " hashes in %.2fs "
+		                "(%.2f kH/s)\n", i, workers[i].hashes,
+		                workers[i].elapsed, r / 1000);
+
+		hashes += workers[i].hashes;
+		rate   += r;
+	}
+
+	fprintf(stderr, "    Total    : %" PRIu64 " hashes (%.2f kH/s)\n",
+	        hashes, rate / 1000);
+}
+
+void
+ds1963s_brute_init(struct ds1963s_brute *brute)
+{
+	assert(brute != NULL);
+
+	memset(brute, 0, sizeof *brute);
+	brute->log_fd = -1;
+	brute->jobs   = ds1963s_brute_jobs_default();
+	brute->width  = DS1963S_BRUTE_WIDTH_DEFAULT;
+	ds1963s_dev_init(&brute->dev);
+}
+
+void
+ds1963s_brute_destroy(struct ds1963s_brute *brute)
+{
+	assert(brute != NULL);
+
+	ds1963s_dev_destroy(&brute->dev);
+}
+
+int
+ds1963s_brute_jobs_default(void)
+{
+	long n;
+
+	if ( (n = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+		return 1;
+
+	return n;
+}
+
+/* Return the number of links a secret is split into for 'width'. */
+int
+ds1963s_brute_links(int width)
+{
+	assert(width >= 1 && width <= DS1963S_BRUTE_WIDTH_MAX);
+
+	return (8 + width - 1) / width;
+}
+
+/* Measure the rate at which 'brute' tests candidates in hashes per second,
+ * by testing a fixed number of them on the calling thread and scaling the
+ * result to brute->jobs threads.
+ */
+double
+ds1963s_brute_rate(struct ds1963s_brute *brute)
+{
+	struct timespec start_time, end_time;
+	struct ds1963s_brute_secret saved;
+	struct ds1963s_device dev;
+	uint64_t hashes = 0;
+	uint64_t result;
+	double elapsed;
+	int width;
+
+	assert(brute != NULL);
+
+	/* Test link 0 of secret 0 with a width of 4 against a target that
+	 * will not match, so that we always go through the full range.
+	 */
+	memcpy(&saved, &brute->secrets[0], sizeof saved);
+	memset(brute->secrets[0].target_hmac[0], 0, 20);
+	width = brute->width;
+	brute->width = 4;
+
+	memcpy(&dev, &brute->dev, sizeof dev);
+	__brute_link_setup(&dev, brute, 0, 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	__brute_range(&dev, brute, 0, 0, 0, BRUTE_RATE_CANDIDATES,
+	              NULL, &result, &hashes);
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+	brute->width = width;
+	memcpy(&brute->secrets[0], &saved, sizeof saved);
+
+	elapsed = __timespec_diff(&start_time, &end_time);
+	if (elapsed <= 0)
+		elapsed = 1e-9;
+
+	return hashes / elapsed * (brute->jobs > 0 ? brute->jobs : 1);
+}
+
+/* Pick the link width that minimizes the expected time to recover all 8
+ * secrets, given the time a partial secret overwrite takes in seconds and
+ * the hash rate in hashes per second.  Link 0 does not need an overwrite,
+ * a single overwrite serves a pair of secrets, and on average we test half
+ * the candidates of every link.
+ */
+int
+ds1963s_brute_width_auto(double write_latency, double hash_rate)
+{
+	double cost, best_cost = 0;
+	int best = DS1963S_BRUTE_WIDTH_DEFAULT;
+	int link, links, width;
+
+	assert(hash_rate > 0);
+
+	for (width = 1; width <= DS1963S_BRUTE_WIDTH_MAX; width++) {
+		links = ds1963s_brute_links(width);
+		cost  = 4 * (links - 1) * write_latency;
+
+		for (link = 0; link < links; link++) {
+			int bytes = MIN(width, 8 - link * width);
+
+			cost += 8 * ((1ULL << (8 * bytes)) / 2.0) / hash_rate;
+		}
+
+		if (width == 1 || cost < best_cost) {
+			best_cost = cost;
+			best      = width;
+		}
+	}
+
+	return best;
+}
+
+/* Recover a single link on the calling thread. */
+int
+ds1963s_brute_link(struct ds1963s_brute *brute, int secret, int link)
+{
+	uint64_t hashes = 0;
+	uint64_t result;
+
+	assert(brute != NULL);
+	assert(secret >= 0 && secret < 8);
+	assert(link >= 0 && link < ds1963s_brute_links(brute->width));
+
+	__brute_link_setup(&brute->dev, brute, secret, link);
+
+	if (__brute_range(&brute->dev, brute, secret, link, 0,
+	                  __brute_link_space(brute, link), NULL,
+	                  &result, &hashes) == -1)
+		return -1;
+
+	__brute_link_found(brute, secret, link, result);
+	return 0;
+}
+
+/* Recover all 8 secrets using brute->jobs worker threads. */
+int
+ds1963s_brute_run(struct ds1963s_brute *brute)
+{
+	assert(brute != NULL);
+
+	return ds1963s_brute_run_many(&brute, 1, brute->jobs, brute->verbose,
+	                              NULL, NULL);
+}
+
+/* Recover all secrets of 'count' devices using 'jobs' worker threads.
+ * 'done' is called with the index of every device as soon as all its
+ * secrets are done.  It is called with the engine lock held, so it should
+ * not take long.  Returns 0 if all secrets were recovered, and -1 if not.
+ */
+int
+ds1963s_brute_run_many(struct ds1963s_brute **brutes, size_t count,
+                       int jobs, int verbose, ds1963s_brute_done_t done,
+                       void *arg)
+{
+	struct brute_worker *workers;
+	struct brute_engine engine;
+	struct brute_chain *chains;
+	int *remaining;
+	size_t i, j;
+	int ret;
+
+	assert(brutes != NULL);
+
+	if (jobs < 1)
+		jobs = 1;
+
+	chains    = calloc(count * 8, sizeof *chains);
+	remaining = calloc(count, sizeof *remaining);
+	workers   = calloc(jobs, sizeof *workers);
+
+	if (chains == NULL || remaining == NULL || workers == NULL) {
+		free(chains);
+		free(remaining);
+		free(workers);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < 8; j++) {
+			struct brute_chain *chain = &chains[i * 8 + j];
+
+			chain->brute   = brutes[i];
+			chain->index   = i;
+			chain->secret  = j;
+			chain->link    = ds1963s_brute_links(brutes[i]->width) - 1;
+			chain->space   = __brute_link_space(brutes[i], chain->link);
+			brutes[i]->secrets[j].state = DS1963S_BRUTE_SECRET_PENDING;
+		}
+
+		remaining[i] = 8;
+	}
+
+	pthread_mutex_init(&engine.lock, NULL);
+	pthread_cond_init(&engine.cond, NULL);
+	engine.chains      = chains;
+	engine.chain_count = count * 8;
+	engine.chains_done = 0;
+	engine.chain_first = 0;
+	engine.remaining   = remaining;
+	engine.done        = done;
+	engine.done_arg    = arg;
+
+	for (i = 0; i < (size_t)jobs; i++) {
+		workers[i].engine = &engine;
+
+		if (pthread_create(&workers[i].thread, NULL,
+		                   __brute_worker, &workers[i]) != 0)
+			break;
+	}
+
+	/* If we could not start any thread, we do the work ourselves. */
+	if ( (jobs = i) == 0) {
+		workers[0].engine = &engine;
+		__brute_worker(&workers[0]);
+		jobs = 1;
+	} else {
+		for (i = 0; i < (size_t)jobs; i++)
+			pthread_join(workers[i].thread, NULL);
+	}
+
+	if (verbose)
+		__brute_report(workers, jobs);
+
+	pthread_cond_destroy(&engine.cond);
+	pthread_mutex_destroy(&engine.lock);
+	free(workers);
+	free(remaining);
+	free(chains);
+
+	ret = 0;
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < 8; j++) {
+			if (brutes[i]->secrets[j].state != DS1963S_BRUTE_SECRET_FOUND)
+				ret = -1;
+		}
+	}
+
+	return ret;
+}
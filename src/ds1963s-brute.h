@@ -0,0 +1,79 @@
+/* ds1963s-brute.h
+ *
+ * Recover DS1963S secrets from HMAC links obtained by partial overwrites.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2013-2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_BRUTE_H
+#define DS1963S_BRUTE_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "ds1963s-device.h"
+
+#define DS1963S_BRUTE_SECRET_PENDING	0
+#define DS1963S_BRUTE_SECRET_FOUND	1
+#define DS1963S_BRUTE_SECRET_FAILED	2
+
+/* Number of secret bytes recovered per link. */
+#define DS1963S_BRUTE_WIDTH_DEFAULT	2
+#define DS1963S_BRUTE_WIDTH_MAX		4
+#define DS1963S_BRUTE_LINKS_MAX		8
+
+struct ds1963s_brute_secret
+{
+	int		state;
+	int		tail;		/* Links overwrite the last bytes. */
+	uint8_t		target_hmac[DS1963S_BRUTE_LINKS_MAX][20];
+	uint8_t		secret[8];
+};
+
+struct ds1963s_brute
+{
+	int				log_fd;
+	int				jobs;
+	int				width;
+	int				verbose;
+	struct ds1963s_device		dev;
+	struct ds1963s_brute_secret	secrets[8];
+};
+
+typedef void (*ds1963s_brute_done_t)(size_t index,
+                                     struct ds1963s_brute *brute, void *arg);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ds1963s_brute_init(struct ds1963s_brute *brute);
+void ds1963s_brute_destroy(struct ds1963s_brute *brute);
+int  ds1963s_brute_jobs_default(void);
+int  ds1963s_brute_links(int width);
+double ds1963s_brute_rate(struct ds1963s_brute *brute);
+int  ds1963s_brute_width_auto(double write_latency, double hash_rate);
+int  ds1963s_brute_link(struct ds1963s_brute *brute, int secret, int link);
+int  ds1963s_brute_run(struct ds1963s_brute *brute);
+int  ds1963s_brute_run_many(struct ds1963s_brute **brutes, size_t count,
+                            int jobs, int verbose, ds1963s_brute_done_t done,
+                            void *arg);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+/* ds1963s-capture.c
+ *
+ * On-disk captures of the DS1963S state needed to recover its secrets.
+ *
+ * This allows capturing the HMAC links on the machine the DS1963S is
+ * attached to, and recovering the secrets elsewhere.  A capture file is a
+ * fixed size record with all integers in little-endian byte order:
+ *
+ *   offset  size  contents
+ *        0     8  magic "DS1963SC"
+ *        8     4  version
+ *       12     4  link width
+ *       16     4  mask of secrets with tail links
+ *       20     8  ROM
+ *       28   256  data pages 0-7
+ *      284    64  write cycle counters
+ *      348  1280  link HMACs, 8 per secret, as read from the scratchpad
+ *
+ * Only the links used by the link width are meaningful.  Version 2 files
+ * have no tail mask, so all their links overwrite the first bytes.
+ * Version 1 files have no link width field either, a width of 2, and 4
+ * link HMACs per secret.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "ds1963s-capture.h"
+#include "getput.h"
+
+#define CAPTURE_OFFSET_VERSION		8
+
+#define CAPTURE_V1_OFFSET_ROM		12
+#define CAPTURE_V1_OFFSET_DATA		20
+#define CAPTURE_V1_OFFSET_COUNTERS	276
+#define CAPTURE_V1_OFFSET_HMAC		340
+#define CAPTURE_V1_SIZE			980
+
+#define CAPTURE_V2_OFFSET_ROM		16
+#define CAPTURE_V2_OFFSET_DATA		24
+#define CAPTURE_V2_OFFSET_COUNTERS	280
+#define CAPTURE_V2_OFFSET_HMAC		344
+#define CAPTURE_V2_SIZE			1624
+
+#define CAPTURE_OFFSET_WIDTH		12
+#define CAPTURE_OFFSET_TAIL		16
+#define CAPTURE_OFFSET_ROM		20
+#define CAPTURE_OFFSET_DATA		28
+#define CAPTURE_OFFSET_COUNTERS		284
+#define CAPTURE_OFFSET_HMAC		348
+#define CAPTURE_SIZE			1628
+
+static void
+__capture_decode(struct ds1963s_capture *capture, const uint8_t *buf,
+                 size_t rom, size_t data, size_t counters, size_t hmac,
+                 int links)
+{
+	memcpy(capture->rom, &buf[rom], sizeof capture->rom);
+	memcpy(capture->data, &buf[data], sizeof capture->data);
+
+	for (int i = 0; i < 16; i++)
+		capture->counters[i] = GET_32BIT_LSB(&buf[counters + i * 4]);
+
+	memset(capture->target_hmac, 0, sizeof capture->target_hmac);
+	for (int i = 0; i < 8; i++) {
+		memcpy(capture->target_hmac[i], &buf[hmac + i * links * 20],
+		       links * 20);
+	}
+}
+
+int
+ds1963s_capture_read(struct ds1963s_capture *capture, const char *path)
+{
+	uint8_t buf[CAPTURE_SIZE];
+	uint32_t version;
+	size_t ret;
+	FILE *fp;
+
+	assert(capture != NULL);
+	assert(path != NULL);
+
+	if ( (fp = fopen(path, "rb")) == NULL)
+		return -1;
+
+	ret = fread(buf, 1, sizeof buf, fp);
+	fclose(fp);
+
+	if (ret < CAPTURE_OFFSET_VERSION + 4 ||
+	    memcmp(buf, DS1963S_CAPTURE_MAGIC, 8) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	version = GET_32BIT_LSB(&buf[CAPTURE_OFFSET_VERSION]);
+
+	if (version == 1 && ret == CAPTURE_V1_SIZE) {
+		capture->width = 2;
+		capture->tail  = 0;
+		__capture_decode(capture, buf, CAPTURE_V1_OFFSET_ROM,
+		                 CAPTURE_V1_OFFSET_DATA,
+		                 CAPTURE_V1_OFFSET_COUNTERS,
+		                 CAPTURE_V1_OFFSET_HMAC, 4);
+		return 0;
+	}
+
+	if ((version != 2 || ret != CAPTURE_V2_SIZE) &&
+	    (version != DS1963S_CAPTURE_VERSION || ret != CAPTURE_SIZE)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	capture->width = GET_32BIT_LSB(&buf[CAPTURE_OFFSET_WIDTH]);
+	if (capture->width < 1 || capture->width > DS1963S_BRUTE_WIDTH_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (version == 2) {
+		capture->tail = 0;
+		__capture_decode(capture, buf, CAPTURE_V2_OFFSET_ROM,
+		                 CAPTURE_V2_OFFSET_DATA,
+		                 CAPTURE_V2_OFFSET_COUNTERS,
+		                 CAPTURE_V2_OFFSET_HMAC,
+		                 DS1963S_BRUTE_LINKS_MAX);
+		return 0;
+	}
+
+	capture->tail = GET_32BIT_LSB(&buf[CAPTURE_OFFSET_TAIL]);
+	__capture_decode(capture, buf, CAPTURE_OFFSET_ROM, CAPTURE_OFFSET_DATA,
+	                 CAPTURE_OFFSET_COUNTERS, CAPTURE_OFFSET_HMAC,
+	                 DS1963S_BRUTE_LINKS_MAX);
+	return 0;
+}
+
+int
+ds1963s_capture_write(const struct ds1963s_capture *capture, const char *path)
+{
+	uint8_t buf[CAPTURE_SIZE];
+	FILE *fp;
+
+	assert(capture != NULL);
+	assert(path != NULL);
+
+	memcpy(buf, DS1963S_CAPTURE_MAGIC, 8);
+	PUT_32BIT_LSB(&buf[CAPTURE_OFFSET_VERSION], DS1963S_CAPTURE_VERSION);
+	PUT_32BIT_LSB(&buf[CAPTURE_OFFSET_WIDTH], capture->width);
+	PUT_32BIT_LSB(&buf[CAPTURE_OFFSET_TAIL], capture->tail);
+	memcpy(&buf[CAPTURE_OFFSET_ROM], capture->rom, sizeof capture->rom);
+	memcpy(&buf[CAPTURE_OFFSET_DATA], capture->data, sizeof capture->data);
+
+	for (int i = 0; i < 16; i++) {
+		PUT_32BIT_LSB(&buf[CAPTURE_OFFSET_COUNTERS + i * 4],
+		              capture->counters[i]);
+	}
+
+	memcpy(&buf[CAPTURE_OFFSET_HMAC], capture->target_hmac,
+	       sizeof capture->target_hmac);
+
+	if ( (fp = fopen(path, "wb")) == NULL)
+		return -1;
+
+	if (fwrite(buf, 1, sizeof buf, fp) != sizeof buf) {
+		fclose(fp);
+		return -1;
+	}
+
+	return fclose(fp) == EOF ? -1 : 0;
+}
+
+/* Load the device model and link targets of 'brute' from 'capture'. */
+void
+ds1963s_capture_to_brute(const struct ds1963s_capture *capture,
+                         struct ds1963s_brute *brute)
+{
+	assert(capture != NULL);
+	assert(brute != NULL);
+
+	brute->width = capture->width;
+	memcpy(brute->dev.serial, &capture->rom[1], 6);
+	memcpy(brute->dev.data_memory, capture->data, sizeof capture->data);
+
+	for (int i = 0; i < 8; i++) {
+		brute->dev.data_wc[i]   = capture->counters[i];
+		brute->dev.secret_wc[i] = capture->counters[i + 8];
+		brute->secrets[i].tail  = (capture->tail >> i) & 1;
+		memcpy(brute->secrets[i].target_hmac, capture->target_hmac[i],
+		       sizeof brute->secrets[i].target_hmac);
+	}
+}
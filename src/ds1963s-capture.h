@@ -0,0 +1,61 @@
+/* ds1963s-capture.h
+ *
+ * On-disk captures of the DS1963S state needed to recover its secrets.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_CAPTURE_H
+#define DS1963S_CAPTURE_H
+
+#include <inttypes.h>
+#include "ds1963s-brute.h"
+
+#define DS1963S_CAPTURE_MAGIC		"DS1963SC"
+#define DS1963S_CAPTURE_VERSION		3
+
+/* Everything we need to recover the secrets of a DS1963S without having
+ * access to it: the ROM, data pages 0-7, the write cycle counters in the
+ * order returned by ds1963s_write_cycle_get_all(), and the link HMACs of
+ * every secret for the link width used.  Bit n of 'tail' is set when the
+ * links of secret n overwrite its last bytes rather than its first.
+ */
+struct ds1963s_capture
+{
+	int		width;
+	uint8_t		tail;
+	uint8_t		rom[8];
+	uint8_t		data[8][32];
+	uint32_t	counters[16];
+	uint8_t		target_hmac[8][DS1963S_BRUTE_LINKS_MAX][20];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  ds1963s_capture_read(struct ds1963s_capture *capture, const char *path);
+int  ds1963s_capture_write(const struct ds1963s_capture *capture,
+                           const char *path);
+void ds1963s_capture_to_brute(const struct ds1963s_capture *capture,
+                              struct ds1963s_brute *brute);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
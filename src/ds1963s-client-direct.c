@@ -0,0 +1,148 @@
+/* ds1963s-client-direct.c
+ *
+ * A ds1963s client backend for an emulated device in the same process.
+ *
+ * The client transactions are fed straight into the state machine engine
+ * of the device, a byte at a time.  There is no serial port, DS2480B or
+ * 1-wire bus in between, but the device sees exactly the same bytes, so
+ * the client gets the same replies, CRCs and completion patterns.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include "ds1963s-client-direct.h"
+#include "ds1963s-device-sm.h"
+
+#define ROM_CMD_MATCH	0x55
+
+static void
+__ds1963s_direct_destroy(struct ds1963s_client *ctx)
+{
+	free(ctx->private_data);
+	ctx->private_data = NULL;
+}
+
+/* There is nothing on the line but the DS1963S, so it always answers
+ * with a presence pulse.
+ */
+static int
+__ds1963s_direct_reset(struct ds1963s_client *ctx)
+{
+	struct ds1963s_dev_sm *sm = (struct ds1963s_dev_sm *)ctx->private_data;
+
+	ds1963s_dev_sm_reset(sm);
+	return 0;
+}
+
+static int
+__ds1963s_direct_block(struct ds1963s_client *ctx, int reset,
+                       uint8_t *buf, size_t len)
+{
+	struct ds1963s_dev_sm *sm = (struct ds1963s_dev_sm *)ctx->private_data;
+
+	if (reset)
+		ds1963s_dev_sm_reset(sm);
+
+	for (size_t i = 0; i < len; i++)
+		buf[i] = ds1963s_dev_sm_byte(sm, buf[i]);
+
+	return 0;
+}
+
+/* Address the DS1963S with Match ROM, and check that it stayed silent. */
+static int
+__ds1963s_direct_select(struct ds1963s_client *ctx)
+{
+	struct ds1963s_dev_sm *sm = (struct ds1963s_dev_sm *)ctx->private_data;
+	uint8_t buf[9];
+
+	ds1963s_dev_sm_reset(sm);
+
+	buf[0] = ROM_CMD_MATCH;
+	ds1963s_dev_rom_code_get(sm->dev, &buf[1]);
+
+	for (int i = 0; i < 9; i++) {
+		if (ds1963s_dev_sm_byte(sm, buf[i]) != buf[i])
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+__ds1963s_direct_overdrive(struct ds1963s_client *ctx)
+{
+	return 0;
+}
+
+static void
+__ds1963s_direct_rom_get(struct ds1963s_client *ctx, uint8_t rom[8])
+{
+	struct ds1963s_dev_sm *sm = (struct ds1963s_dev_sm *)ctx->private_data;
+
+	ds1963s_dev_rom_code_get(sm->dev, rom);
+}
+
+/* A power-on-reset leaves the device with the HIDE flag set, waiting for
+ * a reset pulse.
+ */
+static int
+__ds1963s_direct_power_cycle(struct ds1963s_client *ctx)
+{
+	struct ds1963s_dev_sm *sm = (struct ds1963s_dev_sm *)ctx->private_data;
+
+	sm->dev->HIDE = 1;
+	ds1963s_dev_sm_init(sm, sm->dev);
+	ctx->power_cycles++;
+
+	return 0;
+}
+
+static const struct ds1963s_client_operations ds1963s_client_direct_ops = {
+	.destroy     = __ds1963s_direct_destroy,
+	.reset       = __ds1963s_direct_reset,
+	.select      = __ds1963s_direct_select,
+	.block       = __ds1963s_direct_block,
+	.overdrive   = __ds1963s_direct_overdrive,
+	.rom_get     = __ds1963s_direct_rom_get,
+	.power_cycle = __ds1963s_direct_power_cycle
+};
+
+/* Bind 'ctx' to 'dev'.  The device must not be on a 1-wire bus at the
+ * same time, as the client drives it directly.
+ */
+int
+ds1963s_client_init_direct(struct ds1963s_client *ctx,
+                           struct ds1963s_device *dev)
+{
+	struct ds1963s_dev_sm *sm;
+
+	assert(ctx != NULL);
+	assert(dev != NULL);
+
+	if ( (sm = malloc(sizeof *sm)) == NULL)
+		return -1;
+
+	ds1963s_dev_sm_init(sm, dev);
+	ds1963s_client_init_ops(ctx, &ds1963s_client_direct_ops, sm);
+	ctx->device_path  = NULL;
+	ctx->copr.portnum = -1;
+
+	return 0;
+}
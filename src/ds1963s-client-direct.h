@@ -0,0 +1,39 @@
+/* ds1963s-client-direct.h
+ *
+ * A ds1963s client backend for an emulated device in the same process.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_CLIENT_DIRECT_H
+#define DS1963S_CLIENT_DIRECT_H
+
+#include "ds1963s-client.h"
+#include "ds1963s-device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ds1963s_client_init_direct(struct ds1963s_client *ctx,
+                               struct ds1963s_device *dev);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
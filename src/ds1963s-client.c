@@ -36,9 +36,23 @@
 extern int fd[MAX_PORTNUM];
 void owClearError(void);
 
+static int __ds1963s_baudrate_parmset(int baudrate)
+{
+	switch (baudrate) {
+	case 19200:
+		return PARMSET_19200;
+	case 57600:
+		return PARMSET_57600;
+	case 115200:
+		return PARMSET_115200;
+	}
+
+	return PARMSET_9600;
+}
+
 static int __ds1963s_acquire(struct ds1963s_client *ctx, const char *port)
 {
-	int portnum;
+	int portnum, parmset;
 
 	if ( (portnum = OpenCOMEx(port)) < 0) {
 		ctx->errno = DS1963S_ERROR_OPENCOM;
@@ -51,6 +65,22 @@ static int __ds1963s_acquire(struct ds1963s_client *ctx, const char *port)
 		return -1;
 	}
 
+	/* The DS2480B always starts out at 9600 bps.  If we are asked to
+	 * go faster and the switch does not work out, we detect it again
+	 * at 9600 bps and carry on at that speed.
+	 */
+	parmset = __ds1963s_baudrate_parmset(ctx->baudrate);
+	if (parmset != PARMSET_9600 &&
+	    DS2480ChangeBaud(portnum, parmset) != parmset) {
+		owClearError();
+
+		if (!DS2480Detect(portnum)) {
+			CloseCOM(portnum);
+			ctx->errno = DS1963S_ERROR_NO_DS2480;
+			return -1;
+		}
+	}
+
 	return portnum;
 }
 
@@ -77,11 +107,90 @@ __ds1963s_find(struct ds1963s_client *ctx, int portnum, unsigned char *devAN)
 	return -1;
 }
 
+static void
+__ds1963s_serial_destroy(struct ds1963s_client *ctx)
+{
+	owRelease(ctx->copr.portnum);
+}
+
+static int
+__ds1963s_serial_reset(struct ds1963s_client *ctx)
+{
+	return owTouchReset(ctx->copr.portnum) ? 0 : -1;
+}
+
+static int
+__ds1963s_serial_select(struct ds1963s_client *ctx)
+{
+	return SelectSHA(ctx->copr.portnum) ? 0 : -1;
+}
+
+static int
+__ds1963s_serial_block(struct ds1963s_client *ctx, int reset,
+                       uint8_t *buf, size_t len)
+{
+	return owBlock(ctx->copr.portnum, reset, buf, len) ? 0 : -1;
+}
+
+static int
+__ds1963s_serial_overdrive(struct ds1963s_client *ctx)
+{
+	return in_overdrive[ctx->copr.portnum & 0xFF];
+}
+
+static void
+__ds1963s_serial_rom_get(struct ds1963s_client *ctx, uint8_t rom[8])
+{
+	owSerialNum(ctx->copr.portnum, rom, TRUE);
+}
+
+static int __ds1963s_serial_power_cycle(struct ds1963s_client *ctx);
+
+static const struct ds1963s_client_operations ds1963s_client_serial_ops = {
+	.destroy     = __ds1963s_serial_destroy,
+	.reset       = __ds1963s_serial_reset,
+	.select      = __ds1963s_serial_select,
+	.block       = __ds1963s_serial_block,
+	.overdrive   = __ds1963s_serial_overdrive,
+	.rom_get     = __ds1963s_serial_rom_get,
+	.power_cycle = __ds1963s_serial_power_cycle
+};
+
+/* Set up 'ctx' to reach the DS1963S through 'ops'. */
+void
+ds1963s_client_init_ops(struct ds1963s_client *ctx,
+                        const struct ds1963s_client_operations *ops,
+                        void *private_data)
+{
+	ctx->resume        = 0;
+	ctx->errno         = 0;
+	ctx->power_cycles  = 0;
+	ctx->reset_hold    = DS1963S_CLIENT_RESET_HOLD_DEFAULT;
+	ctx->reset_latency = 0;
+	ctx->baudrate      = DS1963S_CLIENT_BAUDRATE_DEFAULT;
+	ctx->ops           = ops;
+	ctx->private_data  = private_data;
+}
+
 int
 ds1963s_client_init(ds1963s_client_t *ctx, const char *device)
+{
+	return ds1963s_client_init_baudrate(ctx, device,
+	                                    DS1963S_CLIENT_BAUDRATE_DEFAULT);
+}
+
+/* Like ds1963s_client_init(), but try to run the serial link to the
+ * DS2480B at 'baudrate' bits per second: 9600, 19200, 57600 or 115200.
+ * We fall back to 9600 bps when the DS2480B does not follow.
+ */
+int
+ds1963s_client_init_baudrate(ds1963s_client_t *ctx, const char *device,
+                             int baudrate)
 {
 	SHACopr *copr = &ctx->copr;
 
+	ctx->baudrate = baudrate;
+
 	/* Get port. */
 	if ( (copr->portnum = __ds1963s_acquire(ctx, device)) == -1)
 		return -1;
@@ -90,9 +199,9 @@ ds1963s_client_init(ds1963s_client_t *ctx, const char *device)
 	if (__ds1963s_find(ctx, copr->portnum, copr->devAN) == -1)
 		return -1;
 
-	ctx->resume      = 0;
+	ds1963s_client_init_ops(ctx, &ds1963s_client_serial_ops, NULL);
 	ctx->device_path = device;
-	ctx->errno       = 0;
+	ctx->baudrate    = baudrate;
 
 	return 0;
 }
@@ -100,13 +209,13 @@ ds1963s_client_init(ds1963s_client_t *ctx, const char *device)
 void
 ds1963s_client_destroy(ds1963s_client_t *ctx)
 {
-	owRelease(ctx->copr.portnum);
+	ctx->ops->destroy(ctx);
 }
 
 static inline int
 __ds1963s_client_select_sha(ds1963s_client_t *ctx)
 {
-	if (SelectSHA(ctx->copr.portnum) == FALSE) {
+	if (ctx->ops->select(ctx) == -1) {
 		ctx->errno = DS1963S_ERROR_ACCESS;
 		return -1;
         }
@@ -114,6 +223,97 @@ __ds1963s_client_select_sha(ds1963s_client_t *ctx)
 	return 0;
 }
 
+static inline int
+__ds1963s_client_block(ds1963s_client_t *ctx, int reset,
+                       uint8_t *buf, size_t len)
+{
+	return ctx->ops->block(ctx, reset, buf, len) == 0;
+}
+
+/* The number of verification bytes to read for a command.  Overdrive
+ * speed needs more of them to cover the same time.
+ */
+static inline int
+__ds1963s_client_num_verf(ds1963s_client_t *ctx, int normal, int overdrive)
+{
+	return ctx->ops->overdrive(ctx) ? overdrive : normal;
+}
+
+/* The DS1963S sends 1 bits during a command and signals it finished by
+ * sending an alternating pattern of 0 and 1 bits.
+ */
+static inline int
+__ds1963s_client_completed(uint8_t byte)
+{
+	return (byte & 0xF0) == 0x50 || (byte & 0xF0) == 0xA0;
+}
+
+/* Read the full scratchpad, and check its CRC16. */
+static int
+__ds1963s_client_read_scratchpad(ds1963s_client_t *ctx, int resume,
+                                 int *address, uint8_t *es, uint8_t *data)
+{
+	uint8_t buf[40];
+	int bytes_read;
+	int i = 0;
+
+	if (resume)
+		buf[i++] = ROM_CMD_RESUME;
+	else if (__ds1963s_client_select_sha(ctx) == -1)
+		return -1;
+
+	buf[i++] = CMD_READ_SCRATCHPAD;
+	memset(&buf[i], 0xFF, 37);
+	i += 37;
+
+	OWASSERT(__ds1963s_client_block(ctx, resume, buf, i),
+	         OWERROR_BLOCK_FAILED, -1);
+
+	bytes_read = 32 - (buf[resume + 1] & 0x1F);
+	OWASSERT(ds1963s_crc16(&buf[resume], bytes_read + 6) == 0xB001,
+	         OWERROR_CRC_FAILED, -1);
+
+	if (address)
+		*address = ds1963s_ta_to_address(buf[resume + 1],
+		                                 buf[resume + 2]);
+	if (es)
+		*es = buf[resume + 3];
+
+	memcpy(data, &buf[resume + 4], 32);
+
+	return 0;
+}
+
+static int
+__ds1963s_client_copy_scratchpad(ds1963s_client_t *ctx, int resume,
+                                 int address, uint8_t es)
+{
+	uint8_t buf[10];
+	int     num_verf;
+	int     i = 0;
+
+	if (resume)
+		buf[i++] = ROM_CMD_RESUME;
+	else if (__ds1963s_client_select_sha(ctx) == -1)
+		return -1;
+
+	num_verf = __ds1963s_client_num_verf(ctx, 2, 4);
+
+	buf[i++] = CMD_COPY_SCRATCHPAD;
+	buf[i++] = address & 0xFF;
+	buf[i++] = (address >> 8) & 0xFF;
+	buf[i++] = es;
+	memset(&buf[i], 0xFF, num_verf);
+	i += num_verf;
+
+	OWASSERT(__ds1963s_client_block(ctx, resume, buf, i),
+	         OWERROR_BLOCK_FAILED, -1);
+	OWASSERT(__ds1963s_client_completed(buf[i - 1]),
+	         OWERROR_NO_COMPLETION_BYTE, -1);
+
+	return 0;
+}
+
 int
 ds1963s_client_page_to_address(ds1963s_client_t *ctx, int page)
 {
@@ -139,9 +339,7 @@ ds1963s_client_address_to_page(ds1963s_client_t *ctx, int address)
 void
 ds1963s_client_rom_get(ds1963s_client_t *ctx, struct ds1963s_rom *rom)
 {
-	int portnum = ctx->copr.portnum;
-
-	owSerialNum(portnum, rom->raw, TRUE);
+	ctx->ops->rom_get(ctx, rom->raw);
 
 	rom->family = rom->raw[0];
 	rom->crc    = rom->raw[7];
@@ -178,12 +376,11 @@ int
 ds1963s_client_taes_get(struct ds1963s_client *ctx, uint16_t *addr, uint8_t *es)
 {
 	uint8_t buf[DS1963S_SCRATCHPAD_SIZE];
-	int portnum = ctx->copr.portnum;
 	uint8_t __es;
 	int __addr;
 
-        OWASSERT(ReadScratchpadSHA18(portnum, &__addr, &__es, buf, 0),
-                 OWERROR_READ_SCRATCHPAD_FAILED, -1);
+	OWASSERT(__ds1963s_client_read_scratchpad(ctx, 0, &__addr, &__es, buf) == 0,
+	         OWERROR_READ_SCRATCHPAD_FAILED, -1);
 
 	if (addr)
 		*addr = __addr;
@@ -218,7 +415,6 @@ ds1963s_client_hash_read(ds1963s_client_t *ctx, uint8_t h[DS1963S_HASH_SIZE])
 int
 ds1963s_client_sp_read(ds1963s_client_t *ctx, ds1963s_client_sp_read_reply_t *reply)
 {
-	int portnum = ctx->copr.portnum;
 	size_t bytes_read;
 	uint8_t buf[40];
 	uint16_t crc;
@@ -236,7 +432,8 @@ ds1963s_client_sp_read(ds1963s_client_t *ctx, ds1963s_client_sp_read_reply_t *re
 	i += 37;
 
 	/* Send the buffer out. */
-	OWASSERT(owBlock(portnum, ctx->resume, buf, i), OWERROR_BLOCK_FAILED, -1);
+	OWASSERT(__ds1963s_client_block(ctx, ctx->resume, buf, i),
+	         OWERROR_BLOCK_FAILED, -1);
 
 	/* Calculate the bytes read from the scratchpad based on TA1(4:0). */
 	bytes_read = buf[ctx->resume + 1];
@@ -271,7 +468,6 @@ int
 ds1963s_client_read_auth(ds1963s_client_t *ctx, int address,
                          ds1963s_client_read_auth_page_reply_t *reply)
 {
-	int portnum = ctx->copr.portnum;
 	uint8_t read_size;
 	uint8_t buf[56];
 	uint16_t crc;
@@ -290,7 +486,7 @@ ds1963s_client_read_auth(ds1963s_client_t *ctx, int address,
 	read_size = 32 - (address % 32);
 
 	/* XXX: study how overdrive works. */
-	num_verf = (in_overdrive[portnum&0x0FF]) ? 10 : 2;
+	num_verf = __ds1963s_client_num_verf(ctx, 2, 10);
 
 	buf[i++] = CMD_READ_AUTH_PAGE;
 	buf[i++] = address & 0xFF;
@@ -303,7 +499,7 @@ ds1963s_client_read_auth(ds1963s_client_t *ctx, int address,
 	i += 10 + read_size + num_verf;
 
 	/* Send the block. */
-	OWASSERT(owBlock(portnum, ctx->resume, buf, i),
+	OWASSERT(__ds1963s_client_block(ctx, ctx->resume, buf, i),
 	         OWERROR_BLOCK_FAILED, -1);
 
 	/* Calculate the CRC over the received data; that is command byte,
@@ -315,9 +511,8 @@ ds1963s_client_read_auth(ds1963s_client_t *ctx, int address,
 	 * that the SHA1 computation finished by sending an alternating pattern
 	 * of 0 and 1 bits.  We detect this pattern here.
 	 */
-	OWASSERT( ((buf[i - 1] & 0xF0) == 0x50) ||
-             ((buf[i - 1] & 0xF0) == 0xA0),
-             OWERROR_NO_COMPLETION_BYTE, -1);
+	OWASSERT(__ds1963s_client_completed(buf[i - 1]),
+	         OWERROR_NO_COMPLETION_BYTE, -1);
 
 	memcpy(reply->data, &buf[i - 10 - read_size - num_verf], read_size);
 	reply->data_size = read_size;
@@ -332,14 +527,33 @@ ds1963s_client_read_auth(ds1963s_client_t *ctx, int address,
 int
 ds1963s_client_sha_command(ds1963s_client_t *ctx, uint8_t cmd, int address)
 {
-	int portnum;
+	uint8_t buf[18];
+	int num_verf;
+	int i = 0;
 
 	assert(ctx != NULL);
 	assert(address >= 0 && address <= 0xFFFF);
 
-       	portnum = ctx->copr.portnum;
+	if (ctx->resume)
+		buf[i++] = ROM_CMD_RESUME;
+	else if (__ds1963s_client_select_sha(ctx) == -1)
+		return -1;
+
+	num_verf = __ds1963s_client_num_verf(ctx, 2, 10);
+
 	/* Generate the secret using the SHA cmd command. */
-	if (SHAFunction18(portnum, cmd, address, ctx->resume) == FALSE) {
+	buf[i++] = CMD_COMPUTE_SHA;
+	buf[i++] = address & 0xFF;
+	buf[i++] = (address >> 8) & 0xFF;
+	buf[i++] = cmd;
+
+	/* Padding for the CRC16 and the verification bytes. */
+	memset(&buf[i], 0xFF, 2 + num_verf);
+	i += 2 + num_verf;
+
+	if (!__ds1963s_client_block(ctx, ctx->resume, buf, i) ||
+	    ds1963s_crc16(&buf[ctx->resume], 6) != 0xB001 ||
+	    !__ds1963s_client_completed(buf[i - 1])) {
 		ctx->errno = DS1963S_ERROR_SHA_FUNCTION;
 		return -1;
 	}
@@ -386,48 +600,32 @@ ds1963s_client_authenticate_host(ds1963s_client_t *ctx, int address)
 int
 ds1963s_client_sp_copy(struct ds1963s_client *ctx, int address, uint8_t es)
 {
-	int     portnum = ctx->copr.portnum;
+	return __ds1963s_client_copy_scratchpad(ctx, ctx->resume, address, es);
+}
+
+int
+ds1963s_client_sp_erase(struct ds1963s_client *ctx, int address)
+{
 	uint8_t buf[10];
-	int     num_verf;
-	int     i = 0;
+	int num_verf;
+	int i = 0;
 
-	if (ctx->resume) {
+	if (ctx->resume)
 		buf[i++] = ROM_CMD_RESUME;
-	} else if (__ds1963s_client_select_sha(ctx) == -1) {
+	else if (__ds1963s_client_select_sha(ctx) == -1)
 		return -1;
-	}
 
-	// change number of verification bytes if in overdrive
-	num_verf = (in_overdrive[portnum&0xFF]) ? 4 : 2;
+	num_verf = __ds1963s_client_num_verf(ctx, 2, 6);
 
-	buf[i++] = CMD_COPY_SCRATCHPAD;
+	/* Erase the scratchpad to clear the HIDE flag. */
+	buf[i++] = CMD_ERASE_SCRATCHPAD;
 	buf[i++] = address & 0xFF;
 	buf[i++] = (address >> 8) & 0xFF;
-	buf[i++] = es;
-
-	// verification bytes
 	memset(&buf[i], 0xFF, num_verf);
 	i += num_verf;
 
-	// now send the block
-	OWASSERT( owBlock(portnum, ctx->resume, buf, i),
-		OWERROR_BLOCK_FAILED, FALSE );
-
-	// check verification
-	OWASSERT( ((buf[i - 1] & 0xF0) == 0x50) ||
-	          ((buf[i - 1] & 0xF0) == 0xA0),
-	         OWERROR_NO_COMPLETION_BYTE, FALSE);
-
-	return 0;
-}
-
-int
-ds1963s_client_sp_erase(struct ds1963s_client *ctx, int address)
-{
-	int portnum = ctx->copr.portnum;
-
-	/* Erase the scratchpad to clear the HIDE flag. */
-	if (EraseScratchpadSHA18(portnum, address, ctx->resume) == FALSE) {
+	if (!__ds1963s_client_block(ctx, ctx->resume, buf, i) ||
+	    !__ds1963s_client_completed(buf[i - 1])) {
 		ctx->errno = DS1963S_ERROR_SP_ERASE;
 		return -1;
 	}
@@ -438,24 +636,38 @@ ds1963s_client_sp_erase(struct ds1963s_client *ctx, int address)
 int
 ds1963s_client_sp_match(struct ds1963s_client *ctx, uint8_t hash[20])
 {
-	int ret;
+	uint8_t buf[25];
+	int i = 0;
 
 	assert(ctx != NULL);
 
-	ret = MatchScratchpadSHA18(ctx->copr.portnum, hash, ctx->resume);
-	if (ret == -1) {
+	if (ctx->resume)
+		buf[i++] = ROM_CMD_RESUME;
+	else if (__ds1963s_client_select_sha(ctx) == -1)
+		return -1;
+
+	buf[i++] = CMD_MATCH_SCRATCHPAD;
+	memcpy(&buf[i], hash, 20);
+	i += 20;
+
+	/* Padding for the CRC16 and the verification byte. */
+	memset(&buf[i], 0xFF, 3);
+	i += 3;
+
+	if (!__ds1963s_client_block(ctx, ctx->resume, buf, i) ||
+	    ds1963s_crc16(&buf[ctx->resume], 23) != 0xB001) {
 		ctx->errno = DS1963S_ERROR_MATCH_SCRATCHPAD;
 		return -1;
 	}
 
-	return ret == TRUE;
+	/* A match is answered with alternating 0 and 1 bits. */
+	return buf[i - 1] != 0xFF;
 }
 
 int
 ds1963s_client_sp_write(struct ds1963s_client *ctx, uint16_t address,
                         const uint8_t *data, size_t len)
 {
-	int portnum = ctx->copr.portnum;
 	uint8_t buf[64];
 	int i = 0;
 
@@ -479,12 +691,12 @@ ds1963s_client_sp_write(struct ds1963s_client *ctx, uint16_t address,
 	/* payload */
 	memcpy(buf + i, data, len);
 
-	if (owBlock(portnum, 0, buf, len + i) == FALSE) {
+	if (!__ds1963s_client_block(ctx, 0, buf, len + i)) {
 		ctx->errno = DS1963S_ERROR_TX_BLOCK;
 		return -1;
 	}
 
-	owTouchReset(portnum);
+	ctx->ops->reset(ctx);
 
 	return 0;
 }
@@ -492,7 +704,6 @@ ds1963s_client_sp_write(struct ds1963s_client *ctx, uint16_t address,
 int ds1963s_client_memory_read(struct ds1963s_client *ctx, uint16_t address,
                                uint8_t *data, size_t size)
 {
-	int     portnum = ctx->copr.portnum;
 	uint8_t block[160];
 
 	if (size > sizeof(block) - 3) {
@@ -511,8 +722,9 @@ int ds1963s_client_memory_read(struct ds1963s_client *ctx, uint16_t address,
 	/* TA2, which is unused. */
 	block[2] = address >> 8;
 
-	OWASSERT(owBlock(portnum, 0, block, size + 3), OWERROR_BLOCK_FAILED, -1);
-	owTouchReset(portnum);
+	OWASSERT(__ds1963s_client_block(ctx, 0, block, size + 3),
+	         OWERROR_BLOCK_FAILED, -1);
+	ctx->ops->reset(ctx);
 
 	memcpy(data, &block[3], size);
 	return 0;
@@ -521,7 +733,6 @@ int ds1963s_client_memory_read(struct ds1963s_client *ctx, uint16_t address,
 int ds1963s_client_memory_write(struct ds1963s_client *ctx, uint16_t address,
                                 const uint8_t *data, size_t size)
 {
-	int portnum = ctx->copr.portnum;
 	uint8_t buffer[32];
 	uint8_t es = 0;
 	int addr_buff;
@@ -544,7 +755,8 @@ int ds1963s_client_memory_write(struct ds1963s_client *ctx, uint16_t address,
 		return -1;
 
 	/* Read back the data from the scratchpad to verify TA/ES/data. */
-	OWASSERT(ReadScratchpadSHA18(portnum, &addr_buff, &es, buffer, TRUE),
+	OWASSERT(__ds1963s_client_read_scratchpad(ctx, 1, &addr_buff, &es,
+	                                          buffer) == 0,
 	         OWERROR_READ_SCRATCHPAD_FAILED, -1);
 
 	/* Verify that what we read is exactly what we wrote. */
@@ -554,7 +766,8 @@ int ds1963s_client_memory_write(struct ds1963s_client *ctx, uint16_t address,
 	         OWERROR_READ_SCRATCHPAD_FAILED, -1);
 
 	/* We latched the data to scratchpad properly, copy to memory. */
-	OWASSERT(CopyScratchpadSHA18(portnum, address, size, TRUE),
+	OWASSERT(__ds1963s_client_copy_scratchpad(ctx, 1, address,
+	                                          (address + size - 1) & 0x1F) == 0,
 	         OWERROR_COPY_SCRATCHPAD_FAILED, -1);
 
 	return 0;
@@ -572,7 +785,6 @@ __write_cycle_address(int write_cycle_type)
 uint32_t ds1963s_client_write_cycle_get(struct ds1963s_client *ctx, int write_cycle_type)
 {
 	int address = __write_cycle_address(write_cycle_type);
-	int portnum = ctx->copr.portnum;
 	uint8_t block[7];
 
 	if (__ds1963s_client_select_sha(ctx) == -1)
@@ -586,8 +798,9 @@ uint32_t ds1963s_client_write_cycle_get(struct ds1963s_client *ctx, int write_cy
 	/* TA2, which is unused. */
 	block[2] = address >> 8;
 
-	OWASSERT(owBlock(portnum, 0, block, 7), OWERROR_BLOCK_FAILED, FALSE);
-	owTouchReset(portnum);
+	OWASSERT(__ds1963s_client_block(ctx, 0, block, 7),
+	         OWERROR_BLOCK_FAILED, FALSE);
+	ctx->ops->reset(ctx);
 
 	return GET_32BIT_LSB(&block[3]);
 }
@@ -596,7 +809,6 @@ int
 ds1963s_write_cycle_get_all(struct ds1963s_client *ctx, uint32_t counters[16])
 {
 	int address = __write_cycle_address(WRITE_CYCLE_DATA_8);
-	int portnum = ctx->copr.portnum;
 	uint8_t block[67];
 	int i;
 
@@ -611,8 +823,9 @@ ds1963s_write_cycle_get_all(struct ds1963s_client *ctx, uint32_t counters[16])
 	/* TA2, which is unused. */
 	block[2] = address >> 8;
 
-	OWASSERT(owBlock(portnum, 0, block, sizeof block), OWERROR_BLOCK_FAILED, -1);
-	owTouchReset(portnum);
+	OWASSERT(__ds1963s_client_block(ctx, 0, block, sizeof block),
+	         OWERROR_BLOCK_FAILED, -1);
+	ctx->ops->reset(ctx);
 
 	for (i = 0; i < 16; i++)
 		counters[i] = GET_32BIT_LSB(&block[i * 4 + 3]);
@@ -622,7 +835,6 @@ ds1963s_write_cycle_get_all(struct ds1963s_client *ctx, uint32_t counters[16])
 
 uint32_t ds1963s_client_prng_get(struct ds1963s_client *ctx)
 {
-	int portnum = ctx->copr.portnum;
 	int address = 0x2A0;
 	uint8_t block[7];
 
@@ -637,33 +849,75 @@ uint32_t ds1963s_client_prng_get(struct ds1963s_client *ctx)
 	/* TA2, which is unused. */
 	block[2] = address >> 8;
 
-	OWASSERT(owBlock(portnum, 0, block, sizeof block), OWERROR_BLOCK_FAILED, -1);
-	owTouchReset(portnum);
+	OWASSERT(__ds1963s_client_block(ctx, 0, block, sizeof block),
+	         OWERROR_BLOCK_FAILED, -1);
+	ctx->ops->reset(ctx);
 
 	return GET_32BIT_LSB(&block[3]);
 }
 
+/* Milliseconds since 'start'.  msGettick() wraps around every 65536
+ * seconds.
+ */
+static long __ds1963s_elapsed(long start)
+{
+	long elapsed = msGettick() - start;
+
+	return elapsed < 0 ? elapsed + 65536000 : elapsed;
+}
+
 /* Pulling down the RTS and DTR lines on the serial port for a certain
  * amount of time power-on-resets the iButton.
+ *
+ * We hold the lines down for at least ctx->reset_hold milliseconds, and
+ * then poll for the adapter and a presence pulse with exponential backoff.
+ * The time until the poll that found the DS1963S started is remembered,
+ * so later power cycles on this device can skip the polls that are bound
+ * to fail.  We only wait out part of it up front, so that the remembered
+ * time can also come down when the DS1963S shows up earlier.
  */
-int ds1963s_client_hide_set(struct ds1963s_client *ctx)
+static int __ds1963s_serial_power_cycle(struct ds1963s_client *ctx)
 {
-	int status = 0;
+	int delay, status = 0;
+	long start, poll;
 
 	if (ioctl(fd[ctx->copr.portnum], TIOCMSET, &status) == -1) {
 		ctx->errno = DS1963S_ERROR_SET_CONTROL_BITS;
 		return -1;
 	}
 
-	/* XXX: unclear how long we should sleep for a power-on-reset. */
-	sleep(1);
+	msDelay(ctx->reset_hold);
+	ctx->power_cycles++;
 
-	/* Release and reacquire the port. */
+	/* Release the port, which raises the control lines again. */
 	owRelease(ctx->copr.portnum);
+	start = msGettick();
 
-        ctx->copr.portnum = __ds1963s_acquire(ctx, ctx->device_path);
-	if (ctx->copr.portnum == -1)
-		return -1;
+	if (ctx->reset_latency > 0)
+		msDelay(ctx->reset_latency * 3 / 4);
+
+	for (delay = 1; ; delay = MIN(delay * 2, DS1963S_CLIENT_RESET_POLL_MAX)) {
+		poll = __ds1963s_elapsed(start);
+		ctx->copr.portnum = __ds1963s_acquire(ctx, ctx->device_path);
+
+		/* A presence pulse means the DS1963S is back. */
+		if (ctx->copr.portnum != -1) {
+			if (owTouchReset(ctx->copr.portnum))
+				break;
+
+			owRelease(ctx->copr.portnum);
+			ctx->errno = DS1963S_ERROR_NOT_FOUND;
+		}
+
+		if (__ds1963s_elapsed(start) >= DS1963S_CLIENT_RESET_TIMEOUT) {
+			ctx->copr.portnum = -1;
+			return -1;
+		}
+
+		msDelay(delay);
+	}
+
+	ctx->reset_latency = MIN(poll, DS1963S_CLIENT_RESET_LATENCY_MAX);
 
 	/* Find the DS1963S iButton again, as we've lost it after a
 	 * return to probe condition.
@@ -674,53 +928,69 @@ int ds1963s_client_hide_set(struct ds1963s_client *ctx)
 	return 0;
 }
 
-int ds1963s_client_secret_write(struct ds1963s_client *ctx, int secret,
-                                const void *data, size_t len)
+/* A power-on-reset sets the HIDE flag, which is needed to copy to the
+ * secrets.
+ */
+int ds1963s_client_hide_set(struct ds1963s_client *ctx)
+{
+	return ctx->ops->power_cycle(ctx);
+}
+
+/* Write 'len' bytes of 'data' to secret memory starting at 'address'.
+ * The range may cover several secrets, but needs to stay within a single
+ * 32 byte row of secret memory.  This takes a power cycle, as copying to
+ * secret memory requires the HIDE flag to be set.
+ */
+int ds1963s_client_secret_write_address(struct ds1963s_client *ctx,
+                                        int address, const void *data,
+                                        size_t len)
 {
-	SHACopr *copr = &ctx->copr;
 	uint8_t buf[32];
-	int secret_addr;
-	int address;
+	int offset;
+	int sp_address;
 	uint8_t es;
 
-	if (secret < 0 || secret > 7) {
+	if (address < 0x200 || address >= 0x240) {
 		ctx->errno = DS1963S_ERROR_SECRET_NUM;
 		return -1;
 	}
 
-	if (len > 32) {
+	offset = address & 0x1F;
+	if (len == 0 || offset + len > 32) {
 		ctx->errno = DS1963S_ERROR_SECRET_LEN;
 		return -1;
 	}
 
-        secret_addr = 0x200 + secret * 8;
-
 	/* Erase the scratchpad to clear the HIDE flag. */
 	if (ds1963s_client_sp_erase(ctx, 0) == -1)
 		return -1;
 
-	/* Write the secret data to the scratchpad. */ 
-	if (ds1963s_client_sp_write(ctx, 0, data, len) == -1)
+	/* Write the secret data to the scratchpad at the offset it will be
+	 * copied from.
+	 */
+	if (ds1963s_client_sp_write(ctx, offset, data, len) == -1)
 		return -1;
 
 	/* Read it back to validate it. */
-	if (ReadScratchpadSHA18(copr->portnum, &address, &es, buf, 0) == FALSE) {
+	if (__ds1963s_client_read_scratchpad(ctx, 0, &sp_address, &es, buf) == -1) {
 		ctx->errno = DS1963S_ERROR_SP_READ;
 		return -1;
 	}
 
-	/* Verify if we read what we wrote out. */
-	if (memcmp(buf, data, len) != 0) {
+	/* Verify if we read what we wrote out.  The scratchpad is read
+	 * back starting at the target address, so our data comes first.
+	 */
+	if ((sp_address & 0x1F) != offset || memcmp(buf, data, len) != 0) {
 		ctx->errno = DS1963S_ERROR_INTEGRITY;
 		return -1;
 	}
 
-	/* Now latch in TA1 and TA2 with secret_addr. */
-	if (ds1963s_client_sp_write(ctx, secret_addr, data, len) == -1)
+	/* Now latch in TA1 and TA2 with the secret address. */
+	if (ds1963s_client_sp_write(ctx, address, data, len) == -1)
 		return -1;
 
 	/* Read back address and es for validation. */
-	if (ReadScratchpadSHA18(copr->portnum, &address, &es, buf, 0) == FALSE) {
+	if (__ds1963s_client_read_scratchpad(ctx, 0, &sp_address, &es, buf) == -1) {
 		ctx->errno = DS1963S_ERROR_SP_READ;
 		return -1;
 	}
@@ -730,13 +1000,14 @@ int ds1963s_client_secret_write(struct ds1963s_client *ctx, int secret,
 		return -1;
 
 	/* ??? */
-	if (ReadScratchpadSHA18(copr->portnum, &address, &es, buf, 0) == FALSE) {
+	if (__ds1963s_client_read_scratchpad(ctx, 0, &sp_address, &es, buf) == -1) {
 		ctx->errno = DS1963S_ERROR_SP_READ;
 		return -1;
 	}
 
 	/* Copy scratchpad data to the secret. */
-	if (CopyScratchpadSHA18(copr->portnum, secret_addr, len, 0) == FALSE) {
+	if (__ds1963s_client_copy_scratchpad(ctx, 0, address,
+	                                     (address + len - 1) & 0x1F) == -1) {
 		ctx->errno = DS1963S_ERROR_SP_COPY;
 		return -1;
 	}
@@ -744,6 +1015,23 @@ int ds1963s_client_secret_write(struct ds1963s_client *ctx, int secret,
 	return 0;
 }
 
+int ds1963s_client_secret_write(struct ds1963s_client *ctx, int secret,
+                                const void *data, size_t len)
+{
+	if (secret < 0 || secret > 7) {
+		ctx->errno = DS1963S_ERROR_SECRET_NUM;
+		return -1;
+	}
+
+	if (len > 32) {
+		ctx->errno = DS1963S_ERROR_SECRET_LEN;
+		return -1;
+	}
+
+	return ds1963s_client_secret_write_address(ctx, 0x200 + secret * 8,
+	                                           data, len);
+}
+
 void
 ds1963s_client_perror(struct ds1963s_client *ctx, const char *fmt, ...)
 {
@@ -49,12 +49,42 @@
 #define WRITE_CYCLE_SECRET_6	14
 #define WRITE_CYCLE_SECRET_7	15
 
+/* Timing of the power-on-reset used to set the HIDE flag, in ms. */
+#define DS1963S_CLIENT_RESET_HOLD_DEFAULT	100
+#define DS1963S_CLIENT_RESET_POLL_MAX		32
+#define DS1963S_CLIENT_RESET_TIMEOUT		5000
+#define DS1963S_CLIENT_RESET_LATENCY_MAX	1000
+#define DS1963S_CLIENT_BAUDRATE_DEFAULT		9600
+
+struct ds1963s_client;
+
+/* The 1-wire transactions the client builds all operations from.  By
+ * default they go out over a DS2480B on a serial port, but a backend can
+ * provide them in any other way.  All of them return -1 on failure.
+ */
+struct ds1963s_client_operations
+{
+	void (*destroy)(struct ds1963s_client *);
+	int  (*reset)(struct ds1963s_client *);
+	int  (*select)(struct ds1963s_client *);
+	int  (*block)(struct ds1963s_client *, int reset, uint8_t *, size_t);
+	int  (*overdrive)(struct ds1963s_client *);
+	void (*rom_get)(struct ds1963s_client *, uint8_t rom[8]);
+	int  (*power_cycle)(struct ds1963s_client *);
+};
+
 typedef struct ds1963s_client
 {
 	const char	*device_path;
 	SHACopr		copr;
 	int		resume;
 	int		errno;
+	int		power_cycles;
+	int		reset_hold;	/* Power-on-reset hold in ms.       */
+	int		reset_latency;	/* Learned reset to presence in ms. */
+	int		baudrate;	/* Serial line speed we ask for.    */
+	const struct ds1963s_client_operations *ops;
+	void		*private_data;
 } ds1963s_client_t;
 
 typedef struct
@@ -90,6 +120,11 @@ extern "C" {
 #endif	/* __cplusplus */
 
 int  ds1963s_client_init(struct ds1963s_client *ctx, const char *device);
+int  ds1963s_client_init_baudrate(struct ds1963s_client *ctx,
+                                  const char *device, int baudrate);
+void ds1963s_client_init_ops(struct ds1963s_client *ctx,
+                             const struct ds1963s_client_operations *ops,
+                             void *private_data);
 void ds1963s_client_destroy(struct ds1963s_client *ctx);
 int  ds1963s_client_page_to_address(struct ds1963s_client *ctx, int page);
 int  ds1963s_client_address_to_page(struct ds1963s_client *ctx, int address);
@@ -129,6 +164,9 @@ int ds1963s_client_hide_set(struct ds1963s_client *ctx);
 
 int ds1963s_client_secret_write(struct ds1963s_client *ctx, int secret,
                                 const void *data, size_t len);
+int ds1963s_client_secret_write_address(struct ds1963s_client *ctx,
+                                        int address, const void *data,
+                                        size_t len);
 int ds1963s_client_hash_read(struct ds1963s_client *ctx, uint8_t hash[20]);
 
 #ifdef __cplusplus
@@ -0,0 +1,684 @@
+/* ds1963s-device-sm.c
+ *
+ * A stackless state machine engine for the DS1963S iButton.
+ *
+ * This drives the same device state as ds1963s_dev_power_on() and the
+ * ds1963s_dev_memory_command_*() handlers, but is written as an explicit
+ * state machine that is fed one bus event at a time.  It needs no stack
+ * of its own, so large numbers of devices can be kept in plain arrays
+ * and run without any context switches.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2016-2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <string.h>
+#include "ds1963s-common.h"
+#include "ds1963s-device-sm.h"
+#include "getput.h"
+
+#ifndef DEBUG_SM
+#undef DEBUG_LOG
+#define DEBUG_LOG(x, ...)
+#endif
+
+/* ROM function commands are kept in 'cmd' with this bit set, so they do
+ * not collide with the memory function commands.
+ */
+#define SM_CMD_ROM		0x100
+
+#define SM_RESET_WAIT		0	/* Ignore everything but a reset.    */
+#define SM_ROM			1	/* RX a ROM function command.        */
+#define SM_ROM_SEARCH		2	/* Search ROM bit triplets.          */
+#define SM_MEMORY		3	/* RX a memory function command.     */
+#define SM_RX			4	/* RX 'len' bytes into 'buf'.        */
+#define SM_TX			5	/* TX 'buf' from 'pos' to 'len'.     */
+#define SM_WRITE_SCRATCHPAD	6	/* RX scratchpad bytes at 'count'.   */
+#define SM_READ_MEMORY		7	/* TX memory from 'addr' onwards.    */
+#define SM_ONES			8	/* TX 'count' 1 bits, then success.  */
+#define SM_SUCCESS		9	/* TX alternating 0 and 1 bits.      */
+#define SM_END			10	/* TX 1s until reset.                */
+
+static void
+__sm_slot(struct ds1963s_dev_sm *sm, int state, int bits, int tx)
+{
+	sm->state = state;
+	sm->bits  = bits;
+	sm->tx    = tx;
+}
+
+static inline void
+__sm_rx_byte(struct ds1963s_dev_sm *sm, int state)
+{
+	__sm_slot(sm, state, 8, 0xFF);
+}
+
+static void
+__sm_rx(struct ds1963s_dev_sm *sm, int cmd, int len)
+{
+	sm->cmd = cmd;
+	sm->len = len;
+	sm->pos = 0;
+	__sm_rx_byte(sm, SM_RX);
+}
+
+static void
+__sm_tx(struct ds1963s_dev_sm *sm, int pos, int len)
+{
+	sm->pos = pos;
+	sm->len = len;
+	__sm_slot(sm, SM_TX, 8, sm->buf[pos]);
+}
+
+/* Append the inverted crc16 to 'buf' at 'len' and return the new length. */
+static int
+__sm_crc16_put(struct ds1963s_dev_sm *sm, int len)
+{
+	sm->buf[len++] = ~sm->crc16 & 0xFF;
+	sm->buf[len++] = ~sm->crc16 >> 8;
+	return len;
+}
+
+static inline void
+__sm_end(struct ds1963s_dev_sm *sm)
+{
+	__sm_slot(sm, SM_END, 8, 0xFF);
+}
+
+static void
+__sm_success(struct ds1963s_dev_sm *sm, int ones)
+{
+	sm->count = ones;
+
+	if (ones != 0)
+		__sm_slot(sm, SM_ONES, 1, 1);
+	else
+		__sm_slot(sm, SM_SUCCESS, 1, 0);
+}
+
+static void
+__sm_read_memory_slot(struct ds1963s_dev_sm *sm)
+{
+	struct ds1963s_device *dev = sm->dev;
+	int page;
+
+	ds1963s_address_to_ta(sm->addr, &dev->TA1, &dev->TA2);
+
+	page = ds1963s_address_to_page(sm->addr);
+	if (page == 16 || page == 17)
+		__sm_slot(sm, SM_READ_MEMORY, 8, 0xFF);
+	else
+		__sm_slot(sm, SM_READ_MEMORY, 8, dev->memory[sm->addr]);
+}
+
+static void
+__sm_rom_function(struct ds1963s_dev_sm *sm, int byte)
+{
+	struct ds1963s_device *dev = sm->dev;
+
+	switch (byte) {
+	case 0x33:
+		DEBUG_LOG("[ds1963s-sm|ROM] Read ROM Command\n");
+		dev->RC = 0;
+		sm->cmd = SM_CMD_ROM | byte;
+		ds1963s_dev_rom_code_get(dev, sm->buf);
+		__sm_tx(sm, 0, 8);
+		break;
+	case 0x3C:
+		DEBUG_LOG("[ds1963s-sm|ROM] Overdrive skip ROM\n");
+		dev->RC = 0;
+		dev->OD = 1;
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	case 0x55:
+	case 0x69:
+		DEBUG_LOG("[ds1963s-sm|ROM] (Overdrive) Match ROM Command\n");
+		dev->RC = 0;
+		__sm_rx(sm, SM_CMD_ROM | byte, 8);
+		break;
+	case 0xA5:
+		DEBUG_LOG("[ds1963s-sm|ROM] Resume\n");
+		if (dev->RC == 1)
+			__sm_rx_byte(sm, SM_MEMORY);
+		else
+			__sm_rx_byte(sm, SM_RESET_WAIT);
+		break;
+	case 0xCC:
+		DEBUG_LOG("[ds1963s-sm|ROM] Skip ROM Command\n");
+		dev->RC = 0;
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	case 0xF0:
+		DEBUG_LOG("[ds1963s-sm|ROM] Search ROM\n");
+		dev->RC = 0;
+		sm->count = 0;
+		ds1963s_dev_rom_code_get(dev, sm->buf);
+		__sm_slot(sm, SM_ROM_SEARCH, 1, sm->buf[0] & 1);
+		break;
+	default:
+		DEBUG_LOG("[ds1963s-sm|ROM] Unknown command %.2x\n", byte);
+		__sm_rx_byte(sm, SM_RESET_WAIT);
+		break;
+	}
+}
+
+/* Search ROM sends every ROM bit followed by its complement, and then
+ * reads the direction the master takes.  'count' is the triplet slot.
+ */
+static void
+__sm_rom_search(struct ds1963s_dev_sm *sm, int bit)
+{
+	int b1 = (sm->buf[sm->count / 24] >> (sm->count / 3 % 8)) & 1;
+
+	if (sm->count % 3 == 2 && bit != b1) {
+		DEBUG_LOG("[ds1963s-sm|ROM] Search ROM mismatch\n");
+		__sm_rx_byte(sm, SM_RESET_WAIT);
+		return;
+	}
+
+	if (++sm->count == 64 * 3) {
+		DEBUG_LOG("[ds1963s-sm|ROM] Search ROM match\n");
+		sm->dev->RC = 1;
+		__sm_rx_byte(sm, SM_MEMORY);
+		return;
+	}
+
+	b1 = (sm->buf[sm->count / 24] >> (sm->count / 3 % 8)) & 1;
+
+	switch (sm->count % 3) {
+	case 0:
+		__sm_slot(sm, SM_ROM_SEARCH, 1, b1);
+		break;
+	case 1:
+		__sm_slot(sm, SM_ROM_SEARCH, 1, !b1);
+		break;
+	case 2:
+		__sm_slot(sm, SM_ROM_SEARCH, 1, 1);
+		break;
+	}
+}
+
+static void
+__sm_memory_function(struct ds1963s_dev_sm *sm, int byte)
+{
+	struct ds1963s_device *dev = sm->dev;
+	int offset, len;
+
+	switch (byte) {
+	case 0x0F:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Write Scratchpad\n");
+		dev->CHLG = 0;
+		dev->AUTH = 0;
+		__sm_rx(sm, byte, 2);
+		break;
+	case 0x33:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Compute SHA\n");
+		__sm_rx(sm, byte, 3);
+		break;
+	case 0x3C:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Match Scratchpad\n");
+		dev->CHLG  = 0;
+		dev->MATCH = 0;
+		__sm_rx(sm, byte, 20);
+		break;
+	case 0x55:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Copy Scratchpad\n");
+		dev->CHLG = 0;
+		dev->AUTH = 0;
+		__sm_rx(sm, byte, 3);
+		break;
+	case 0xA5:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Read Authenticated Page\n");
+		dev->CHLG = 0;
+		dev->AUTH = 0;
+		__sm_rx(sm, byte, 2);
+		break;
+	case 0xAA:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Read Scratchpad\n");
+		sm->cmd = byte;
+		sm->buf[0] = dev->TA1;
+		sm->buf[1] = dev->TA2;
+		sm->buf[2] = dev->ES;
+		len = 3;
+
+		for (offset = dev->TA1 & 0x1F; offset < 32; offset++)
+			sm->buf[len++] = dev->HIDE ? 0xFF : dev->scratchpad[offset];
+
+		sm->crc16 = ds1963s_crc16_update_byte(0, 0xAA);
+		for (int i = 0; i < len; i++)
+			sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[i]);
+
+		__sm_tx(sm, 0, __sm_crc16_put(sm, len));
+		break;
+	case 0xC3:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Erase Scratchpad\n");
+		dev->CHLG = 0;
+		dev->AUTH = 0;
+		__sm_rx(sm, byte, 2);
+		break;
+	case 0xF0:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Read Memory\n");
+		dev->CHLG = 0;
+		dev->AUTH = 0;
+		__sm_rx(sm, byte, 2);
+		break;
+	default:
+		DEBUG_LOG("[ds1963s-sm|MEMORY] Unknown command %.2x\n", byte);
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	}
+}
+
+/* All command parameters have been received into 'buf'. */
+static void
+__sm_received(struct ds1963s_dev_sm *sm)
+{
+	struct ds1963s_device *dev = sm->dev;
+	uint8_t rom_code[8], CC[4];
+	int len;
+
+	switch (sm->cmd) {
+	case SM_CMD_ROM | 0x55:
+	case SM_CMD_ROM | 0x69:
+		ds1963s_dev_rom_code_get(dev, rom_code);
+		if (memcmp(sm->buf, rom_code, sizeof rom_code) != 0) {
+			__sm_rx_byte(sm, SM_RESET_WAIT);
+			break;
+		}
+
+		dev->RC = 1;
+		if (sm->cmd == (SM_CMD_ROM | 0x69))
+			dev->OD = 1;
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	case 0x0F:
+		sm->addr  = ds1963s_ta_to_address(dev->TA1, dev->TA2);
+		sm->count = dev->TA1 & 0x1F;
+		sm->crc16 = ds1963s_crc16_update_byte(0, 0x0F);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, dev->TA1);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, dev->TA2);
+
+		if (dev->HIDE == 0) {
+			if (sm->addr >= 0x200) {
+				__sm_end(sm);
+				break;
+			}
+			dev->ES &= 0x5F;		/* PF := 0; AA := 0 */
+		} else {
+			if (!ds1963s_address_secret(sm->addr)) {
+				__sm_end(sm);
+				break;
+			}
+			dev->ES  &= 0x5F;		/* PF := 0; AA := 0 */
+			dev->TA1 &= 0xF8;		/* T2:T0 := 0,0,0 */
+			dev->ES  &= 0xE0;		/* E4:E0 := 0,0,0,0,0 */
+			dev->ES  |= dev->TA1 & 0x1F;	/* E4:E0 := T4:T0     */
+			dev->ES  |= 0x07;		/* E2:E0 := 1,1,1     */
+		}
+
+		__sm_rx_byte(sm, SM_WRITE_SCRATCHPAD);
+		break;
+	case 0x33:
+		sm->crc16 = ds1963s_crc16_update_byte(0, 0x33);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, dev->TA1);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, dev->TA2);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[2]);
+		__sm_tx(sm, 0, __sm_crc16_put(sm, 0));
+		break;
+	case 0x3C:
+		sm->crc16 = ds1963s_crc16_update_byte(0, 0x3C);
+		for (int i = 0; i < 20; i++)
+			sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[i]);
+
+		if (dev->AUTH) {
+			dev->AUTH  = 0;
+			dev->MATCH = 1;
+		}
+
+		__sm_tx(sm, 20, __sm_crc16_put(sm, 20));
+		break;
+	case 0x55:
+		sm->addr = ds1963s_ta_to_address(sm->buf[0], sm->buf[1]);
+
+		if ((dev->HIDE == 0 && sm->addr >= 0x200) ||
+		    (dev->HIDE == 1 && !ds1963s_address_secret(sm->addr)) ||
+		    sm->buf[0] != dev->TA1 || sm->buf[1] != dev->TA2 ||
+		    sm->buf[2] != dev->ES ||
+		    (sm->buf[2] & 0x1F) < (sm->addr & 0x1F)) {
+			__sm_end(sm);
+			break;
+		}
+
+		/* The bytes from T4:T0 up to and including E4:E0 are copied. */
+		dev->AA = 1;
+		memcpy(&dev->memory[sm->addr],
+		       &dev->scratchpad[sm->addr & 0x1F],
+		       (sm->buf[2] & 0x1F) - (sm->addr & 0x1F) + 1);
+		__sm_success(sm, 8);
+		break;
+	case 0xA5:
+		sm->addr = ds1963s_ta_to_address(sm->buf[0], sm->buf[1]);
+		sm->page = ds1963s_address_to_page(sm->addr);
+
+		if (sm->addr >= 0x200) {
+			__sm_end(sm);
+			break;
+		}
+
+		sm->crc16 = ds1963s_crc16_update_byte(0, 0xA5);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[0]);
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[1]);
+
+		len = 0;
+		do {
+			sm->buf[len++] = dev->memory[sm->addr];
+		} while (++sm->addr % 32 != 0);
+
+		/* The write cycle counters of the page and its secret. */
+		PUT_32BIT_LSB(CC, dev->data_wc[sm->page]);
+		memcpy(&sm->buf[len], CC, 4);
+		PUT_32BIT_LSB(CC, dev->secret_wc[sm->page]);
+		memcpy(&sm->buf[len + 4], CC, 4);
+		len += 8;
+
+		for (int i = 0; i < len; i++)
+			sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, sm->buf[i]);
+
+		__sm_tx(sm, 0, __sm_crc16_put(sm, len));
+		break;
+	case 0xC3:
+		dev->ES = 0x1f;
+		memset(dev->scratchpad, 0xFF, sizeof dev->scratchpad);
+		__sm_success(sm, 10);
+		break;
+	case 0xF0:
+		sm->addr = ds1963s_ta_to_address(sm->buf[0], sm->buf[1]);
+		if (sm->addr >= 0x2B0)
+			__sm_end(sm);
+		else
+			__sm_read_memory_slot(sm);
+		break;
+	}
+}
+
+/* The crc16 has been sent, so run the SHA function in control byte
+ * 'buf[2]', which it did not overwrite.
+ */
+static void
+__sm_compute_sha(struct ds1963s_dev_sm *sm)
+{
+	struct ds1963s_device *dev = sm->dev;
+
+	switch (sm->buf[2]) {
+	case 0x0F:
+		DEBUG_LOG("[ds1963s-sm|SHA] Compute 1st Secret\n");
+		ds1963s_dev_compute_first_secret(dev);
+		__sm_success(sm, 10);
+		break;
+	case 0xF0:
+		DEBUG_LOG("[ds1963s-sm|SHA] Compute next Secret\n");
+		ds1963s_dev_compute_next_secret(dev);
+		__sm_success(sm, 10);
+		break;
+	case 0x3C:
+		DEBUG_LOG("[ds1963s-sm|SHA] Validate Data Page\n");
+		if (ds1963s_dev_validate_data_page(dev) == -1)
+			__sm_end(sm);
+		else
+			__sm_success(sm, 10);
+		break;
+	case 0xC3:
+		DEBUG_LOG("[ds1963s-sm|SHA] Sign Data Page\n");
+		if (ds1963s_dev_sign_data_page(dev) == -1)
+			__sm_end(sm);
+		else
+			__sm_success(sm, 10);
+		break;
+	case 0xCC:
+		DEBUG_LOG("[ds1963s-sm|SHA] Compute Challenge\n");
+		if (ds1963s_dev_compute_challenge(dev) == -1)
+			__sm_end(sm);
+		else
+			__sm_success(sm, 10);
+		break;
+	case 0xAA:
+		DEBUG_LOG("[ds1963s-sm|SHA] Authenticate Host\n");
+		if (ds1963s_dev_authenticate_host(dev) == -1)
+			__sm_end(sm);
+		else
+			__sm_success(sm, 10);
+		break;
+	default:
+		DEBUG_LOG("[ds1963s-sm|SHA] Unknown command %.2x\n", sm->buf[2]);
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	}
+}
+
+/* All of 'buf' has been sent. */
+static void
+__sm_sent(struct ds1963s_dev_sm *sm)
+{
+	struct ds1963s_device *dev = sm->dev;
+
+	switch (sm->cmd) {
+	case SM_CMD_ROM | 0x33:
+		__sm_rx_byte(sm, SM_MEMORY);
+		break;
+	case 0x33:
+		__sm_compute_sha(sm);
+		break;
+	case 0x3C:
+		if (!memcmp(&dev->scratchpad[8], sm->buf, 20))
+			__sm_success(sm, 0);
+		else
+			__sm_end(sm);
+		break;
+	case 0xA5:
+		dev->X = 0;
+		dev->M = 0;
+		ds1963s_dev_read_auth_page(dev, sm->page);
+		__sm_success(sm, 10);
+		break;
+	default:
+		__sm_end(sm);
+		break;
+	}
+}
+
+/* Process the value seen on the bus in the current slot, and move on to
+ * the next slot.
+ */
+static void
+__sm_step(struct ds1963s_dev_sm *sm, int value)
+{
+	struct ds1963s_device *dev = sm->dev;
+
+	switch (sm->state) {
+	case SM_RESET_WAIT:
+	case SM_END:
+		break;
+	case SM_ROM:
+		__sm_rom_function(sm, value);
+		break;
+	case SM_ROM_SEARCH:
+		__sm_rom_search(sm, value);
+		break;
+	case SM_MEMORY:
+		__sm_memory_function(sm, value);
+		break;
+	case SM_RX:
+		/* These commands load TA1 and TA2 as they come in. */
+		if (sm->pos == 0 && (sm->cmd == 0x0F || sm->cmd == 0x33 ||
+		                     sm->cmd == 0xC3))
+			dev->TA1 = value;
+		if (sm->pos == 1 && (sm->cmd == 0x0F || sm->cmd == 0x33 ||
+		                     sm->cmd == 0xC3))
+			dev->TA2 = value;
+
+		sm->buf[sm->pos++] = value;
+		if (sm->pos == sm->len)
+			__sm_received(sm);
+		break;
+	case SM_TX:
+		if (++sm->pos == sm->len)
+			__sm_sent(sm);
+		else
+			sm->tx = sm->buf[sm->pos];
+		break;
+	case SM_WRITE_SCRATCHPAD:
+		/* E4:E0 track the offset of the last byte written. */
+		if (dev->HIDE == 0) {
+			dev->scratchpad[sm->count] = value;
+			dev->ES = (dev->ES & 0xE0) | sm->count;
+		}
+
+		sm->crc16 = ds1963s_crc16_update_byte(sm->crc16, value);
+
+		if (++sm->count == 32)
+			__sm_tx(sm, 0, __sm_crc16_put(sm, 0));
+		break;
+	case SM_READ_MEMORY:
+		/* DS1963S does not increment addr past 0x2AF. */
+		if (sm->addr == 0x2AF) {
+			__sm_end(sm);
+			break;
+		}
+
+		sm->addr++;
+		__sm_read_memory_slot(sm);
+		break;
+	case SM_ONES:
+		if (--sm->count != 0)
+			break;
+
+		/* Erase Scratchpad clears HIDE after it is done. */
+		if (sm->cmd == 0xC3)
+			dev->HIDE = 0;
+
+		__sm_slot(sm, SM_SUCCESS, 1, 0);
+		break;
+	case SM_SUCCESS:
+		sm->tx = !sm->tx;
+		break;
+	}
+}
+
+void
+ds1963s_dev_sm_init(struct ds1963s_dev_sm *sm, struct ds1963s_device *dev)
+{
+	assert(sm != NULL);
+	assert(dev != NULL);
+
+	memset(sm, 0, sizeof *sm);
+	sm->dev = dev;
+	__sm_rx_byte(sm, SM_RESET_WAIT);
+}
+
+void
+ds1963s_dev_sm_reset(struct ds1963s_dev_sm *sm)
+{
+	assert(sm != NULL);
+
+	DEBUG_LOG("[ds1963s-sm] got reset pulse\n");
+
+	/* A reset while the scratchpad is being written sets PF. */
+	if (sm->state == SM_WRITE_SCRATCHPAD)
+		sm->dev->PF = 1;
+
+	if (sm->dev->sync != NULL)
+		sm->dev->sync(sm->dev);
+
+	sm->acc      = 0;
+	sm->acc_bits = 0;
+	__sm_rx_byte(sm, SM_ROM);
+}
+
+/* The bit the device drives in the next bit slot. */
+int
+ds1963s_dev_sm_tx_bit(const struct ds1963s_dev_sm *sm)
+{
+	if (sm->bits == 1)
+		return sm->tx;
+
+	return (sm->tx >> sm->acc_bits) & 1;
+}
+
+/* The byte the device drives in the next 8 slots, or -1 if that depends
+ * on what it reads in them, as during Search ROM.
+ */
+int
+ds1963s_dev_sm_tx_byte(const struct ds1963s_dev_sm *sm)
+{
+	if (sm->bits != 8 || sm->acc_bits != 0)
+		return -1;
+
+	return sm->tx;
+}
+
+/* Feed the master bit 'bit' to the device, and return the bit on the bus.
+ * On a bus with more devices 'bit' can be the wired-AND of all of them,
+ * as the device driving its own bit again makes no difference.
+ */
+int
+ds1963s_dev_sm_bit(struct ds1963s_dev_sm *sm, int bit)
+{
+	int value;
+
+	assert(sm != NULL);
+	assert(bit == 0 || bit == 1);
+
+	value = bit & ds1963s_dev_sm_tx_bit(sm);
+
+	if (sm->bits == 1) {
+		__sm_step(sm, value);
+		return value;
+	}
+
+	sm->acc |= value << sm->acc_bits;
+	if (++sm->acc_bits == 8) {
+		int byte = sm->acc;
+
+		sm->acc      = 0;
+		sm->acc_bits = 0;
+		__sm_step(sm, byte);
+	}
+
+	return value;
+}
+
+/* Feed the master byte 'byte' to the device, and return the byte on the
+ * bus.  Bytes that fall on bit slots are fed bit by bit.
+ */
+int
+ds1963s_dev_sm_byte(struct ds1963s_dev_sm *sm, int byte)
+{
+	int value = 0;
+
+	assert(sm != NULL);
+
+	if (sm->bits == 8 && sm->acc_bits == 0) {
+		value = byte & sm->tx;
+		__sm_step(sm, value);
+		return value;
+	}
+
+	for (int i = 0; i < 8; i++)
+		value |= ds1963s_dev_sm_bit(sm, (byte >> i) & 1) << i;
+
+	return value;
+}
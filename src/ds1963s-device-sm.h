@@ -0,0 +1,72 @@
+/* ds1963s-device-sm.h
+ *
+ * A stackless state machine engine for the DS1963S iButton.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2016-2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_DEVICE_SM_H
+#define DS1963S_DEVICE_SM_H
+
+#include <inttypes.h>
+#include "ds1963s-device.h"
+
+/* The engine runs a ds1963s_device without a coroutine.  Instead of the
+ * device pulling bits and bytes from the bus, the caller pushes every bus
+ * event into it: a reset pulse, a bit slot or a byte slot.  The state of
+ * the command in progress lives in this structure, so nothing is kept on
+ * a stack between events.
+ *
+ * Every slot the engine is in has a granularity of a single bit or a
+ * whole byte, and a value the device drives on the line, which is 1s when
+ * it is listening.  Bits can always be fed, also in byte slots, but bytes
+ * fed in bit slots are split into bits.
+ */
+struct ds1963s_dev_sm
+{
+	struct ds1963s_device	*dev;
+	int			state;
+	int			cmd;
+	int			bits;		/* 1 or 8 for the next slot. */
+	int			tx;		/* What we drive in it.      */
+	int			acc;		/* Byte slot fed as bits.    */
+	int			acc_bits;
+	int			count;
+	int			page;
+	uint16_t		addr;
+	uint16_t		crc16;
+	uint8_t			buf[48];
+	int			len;
+	int			pos;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ds1963s_dev_sm_init(struct ds1963s_dev_sm *, struct ds1963s_device *);
+void ds1963s_dev_sm_reset(struct ds1963s_dev_sm *);
+int  ds1963s_dev_sm_bit(struct ds1963s_dev_sm *, int);
+int  ds1963s_dev_sm_byte(struct ds1963s_dev_sm *, int);
+int  ds1963s_dev_sm_tx_bit(const struct ds1963s_dev_sm *);
+int  ds1963s_dev_sm_tx_byte(const struct ds1963s_dev_sm *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -28,6 +28,7 @@
 #include "ds1963s-device.h"
 #include "getput.h"
 #include "sha1.h"
+#include "sha1-mb.h"
 
 #define DS1963S_TX_BIT(dev, bit)					\
 	({								\
@@ -61,16 +62,26 @@
 		v;							\
 	})
 
-#define DS1963S_TX_FAIL(dev)						\
-	do {								\
-		DS1963S_TX_BIT(dev, 1);					\
-	} while (1)
+/* Send a pattern until the next reset pulse, which is how every command
+ * ends.  The bus sends it for us, so this never returns a value.
+ */
+#define DS1963S_TX_PATTERN(dev, pattern, bits)				\
+	({								\
+		int v;							\
+									\
+		v = one_wire_bus_member_tx_pattern(&dev->bus_slave,	\
+		                                   pattern, bits);	\
+		if (v == ONE_WIRE_BUS_SIGNAL_TERMINATE) {		\
+			dev->state = DS1963S_STATE_TERMINATED;		\
+			return ONE_WIRE_BUS_SIGNAL_TERMINATE;		\
+		}							\
+									\
+		__ds1963s_dev_do_reset_pulse(dev);			\
+		return ONE_WIRE_BUS_SIGNAL_RESET;			\
+	})
 
-#define DS1963S_TX_SUCCESS(dev)						\
-	do {								\
-		DS1963S_TX_BIT(dev, 0);					\
-		DS1963S_TX_BIT(dev, 1);					\
-	} while (1)
+#define DS1963S_TX_FAIL(dev)		DS1963S_TX_PATTERN(dev, 1, 1)
+#define DS1963S_TX_SUCCESS(dev)		DS1963S_TX_PATTERN(dev, 2, 2)
 
 #define DS1963S_TX_END(dev)	DS1963S_TX_FAIL(dev)
 #define DS1963S_RX_BIT(dev)	DS1963S_TX_BIT(dev, 1)
@@ -126,8 +137,9 @@ __sha1_get_input_1(uint8_t M[64], uint8_t *SS, uint8_t *PP, uint8_t MPX,
  * - Compute Challenge
  */
 static void
-__sha1_get_input_2(uint8_t M[64], uint8_t *SS, uint8_t *CC, uint8_t *PP,
-                   uint8_t FAMC, uint8_t MP, uint8_t *SN, uint8_t *SP)
+__sha1_get_input_2(uint8_t M[64], const uint8_t *SS, const uint8_t *CC,
+                   const uint8_t *PP, uint8_t FAMC, uint8_t MP,
+                   const uint8_t *SN, const uint8_t *SP)
 {
 	memcpy(&M[ 0], &SS[ 0],  4);
 	memcpy(&M[ 4], &PP[ 0], 32);
@@ -204,6 +216,21 @@ __sha1_get_output_2(uint8_t SP[32], uint32_t D, uint32_t E)
 	}
 }
 
+/* Hash the 64 byte input block 'M' the way the DS1963S does.  It runs a
+ * single compression without padding or the final feed-forward, and uses
+ * the internal state A, B, C, D, E as the result.
+ */
+static void
+__ds1963s_dev_sha1(const uint8_t M[64], uint32_t H[5])
+{
+	uint32_t W[16];
+
+	for (int i = 0; i < 16; i++)
+		W[i] = GET_32BIT_MSB(&M[i * 4]);
+
+	ds1963s_sha1_compress_raw(W, H);
+}
+
 static inline void
 __ds1963s_dev_do_reset_pulse(struct ds1963s_device *dev)
 {
@@ -224,6 +251,7 @@ void ds1963s_dev_init(struct ds1963s_device *ds1963s)
 	one_wire_bus_member_init(&ds1963s->bus_slave);
         ds1963s->bus_slave.device = (void *)ds1963s;
         ds1963s->bus_slave.driver = (void(*)(void *))ds1963s_dev_power_on;
+	ds1963s->bus_slave.stack_size = DS1963S_DEV_STACK_SIZE;
 
 #ifdef DEBUG
 	strncpy(ds1963s->bus_slave.name, "ds1963s", sizeof ds1963s->bus_slave.name);
@@ -331,10 +359,9 @@ static void
 __ds1963s_dev_compute_secret(struct ds1963s_device *dev, uint8_t secret[8])
 {
 	uint8_t  M[64];
-	uint16_t addr;
 	int      page;
 	uint8_t  *SS;
-	SHA1_CTX ctx;
+	uint32_t H[5];
 
 	assert(dev != NULL);
 
@@ -350,8 +377,7 @@ __ds1963s_dev_compute_secret(struct ds1963s_device *dev, uint8_t secret[8])
 	/* XXX: unclear of the ds1963s page aligns all this or just uses
 	 * the address.  Test later.
 	 */
-	addr = ds1963s_ta_to_address(dev->TA1, dev->TA2);
-	page = ds1963s_address_to_page(addr);
+	page = ds1963s_dev_page_get(dev);
 
 	__sha1_get_input_1(
 		M,
@@ -361,20 +387,10 @@ __ds1963s_dev_compute_secret(struct ds1963s_device *dev, uint8_t secret[8])
 		dev->scratchpad
 	);
 
-	/* We omit the finalize, as the DS1963S does not use it, but rather
-	 * uses the internal state A, B, C, D, E for the result.  This also
-	 * means we have to subtract the initial state from the context, as
-	 * it has added these to the results.
-	 */
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, M, sizeof M);
+	__ds1963s_dev_sha1(M, H);
 
 	/* Write the results to the scratchpad. */
-	__sha1_get_output_2(
-		dev->scratchpad,
-		ctx.state[3] - 0x10325476,
-		ctx.state[4] - 0xC3D2E1F0
-	);
+	__sha1_get_output_2(dev->scratchpad, H[3], H[4]);
 
 	dev->prng_counter++;
 }
@@ -389,52 +405,114 @@ ds1963s_dev_compute_first_secret(struct ds1963s_device *dev)
 void
 ds1963s_dev_compute_next_secret(struct ds1963s_device *dev)
 {
-	int addr, page;
+	int page;
 
-	/* Check the page this address belongs to. */
-	addr = ds1963s_ta_to_address(dev->TA1, dev->TA2);
-	page = ds1963s_address_to_page(addr);
+	/* Check the page this address belongs to.  Like the other SHA
+	 * functions we only look at the low 10 address bits, as anything
+	 * else would index outside of secret memory.
+	 */
+	page = ds1963s_dev_page_get(dev);
 
 	__ds1963s_dev_compute_secret(dev, &dev->secret_memory[(page % 8) * 8]);
 }
 
-void
-ds1963s_dev_read_auth_page(struct ds1963s_device *dev, int page)
+/* Build the SHA-1 input block Read Authenticated Page hashes for 'page'
+ * using 'secret', with scratchpad bytes 20-22 taken from 'challenge'.
+ */
+static void
+__ds1963s_dev_read_auth_page_input(const struct ds1963s_device *dev,
+                                   int page, int secret,
+                                   const uint8_t challenge[3], uint32_t W[16])
 {
-	uint8_t M[64];
-	uint8_t CC[4];
-	SHA1_CTX ctx;
+	uint8_t M[64], CC[4], SP[32];
+	int i;
 
 	PUT_32BIT_LSB(CC, dev->data_wc[page]);
+	memcpy(&SP[20], challenge, 3);
 
 	__sha1_get_input_2(
 		M,
-		&dev->secret_memory[(page % 8) * 8],
+		&dev->secret_memory[secret * 8],
 		CC,
-		&dev->data_memory[(page % 16) * 32],
+		&dev->data_memory[page * 32],
 		DS1963S_DEVICE_FAMILY,
 		__mp_get(dev->M, dev->X, page),
 		dev->serial,
-		dev->scratchpad
+		SP
 	);
 
-	/* We omit the finalize, as the DS1963S does not use it, but rather
-	 * uses the internal state A, B, C, D, E for the result.  This also
-	 * means we have to subtract the initial state from the context, as
-	 * it has added these to the results.
-	 */
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, M, sizeof M);
+	for (i = 0; i < 16; i++)
+		W[i] = GET_32BIT_MSB(&M[i * 4]);
+}
+
+/* Store the SHA-1 input block Read Authenticated Page would hash as 16
+ * big-endian words, so that it can be fed to the multi-buffer kernels.
+ */
+void
+ds1963s_dev_read_auth_page_input(struct ds1963s_device *dev, int page,
+                                 uint32_t W[16])
+{
+	__ds1963s_dev_read_auth_page_input(dev, page % 16, page % 8,
+	                                   &dev->scratchpad[20], W);
+}
+
+/* Compute the Read Authenticated Page MACs for 'count' requests on the
+ * device image 'dev' without changing it, and store them in 'mac' in the
+ * byte order they would be read from scratchpad bytes 8-27.  Every
+ * request names the data page, the secret used and scratchpad bytes
+ * 20-22.  The blocks are hashed in batches by the multi-buffer kernels.
+ * Returns 0 on success, and -1 if a request is out of range.
+ */
+int
+ds1963s_dev_read_auth_page_batch(const struct ds1963s_device *dev,
+                                 const struct ds1963s_dev_auth_request *req,
+                                 uint8_t (*mac)[20], size_t count)
+{
+	uint32_t W[DS1963S_DEV_AUTH_BATCH][16];
+	uint32_t H[DS1963S_DEV_AUTH_BATCH][5];
+	size_t i, j, n;
+
+	assert(dev != NULL);
+	assert(req != NULL || count == 0);
+	assert(mac != NULL || count == 0);
+
+	for (i = 0; i < count; i++) {
+		if (req[i].page < 0 || req[i].page > 15 ||
+		    req[i].secret < 0 || req[i].secret > 7)
+			return -1;
+	}
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < DS1963S_DEV_AUTH_BATCH ?
+		    count - i : DS1963S_DEV_AUTH_BATCH;
+
+		for (j = 0; j < n; j++) {
+			__ds1963s_dev_read_auth_page_input(dev, req[i + j].page,
+				req[i + j].secret, req[i + j].challenge, W[j]);
+		}
+
+		sha1_mb_compress_raw((const uint32_t (*)[16])W, H, n);
+
+		/* The scratchpad holds E, D, C, B, A in little-endian order. */
+		for (j = 0; j < n; j++) {
+			for (int k = 0; k < 5; k++)
+				PUT_32BIT_LSB(&mac[i + j][k * 4], H[j][4 - k]);
+		}
+	}
+
+	return 0;
+}
+
+void
+ds1963s_dev_read_auth_page(struct ds1963s_device *dev, int page)
+{
+	uint32_t W[16], H[5];
+
+	ds1963s_dev_read_auth_page_input(dev, page, W);
+	ds1963s_sha1_compress_raw(W, H);
 
 	/* Write the results to the scratchpad. */
-	__sha1_get_output_1(
-		dev->scratchpad,
-		ctx.state[0] - 0x67452301,
-		ctx.state[1] - 0xEFCDAB89,
-		ctx.state[2] - 0x98BADCFE,
-		ctx.state[3] - 0x10325476,
-		ctx.state[4] - 0xC3D2E1F0
-	);
+	__sha1_get_output_1(dev->scratchpad, H[0], H[1], H[2], H[3], H[4]);
 
 	dev->prng_counter++;
 }
@@ -444,7 +522,7 @@ __ds1963s_dev_sign_data_page(struct ds1963s_device *dev)
 {
 	uint8_t  M[64];
 	int      page;
-	SHA1_CTX ctx;
+	uint32_t H[5];
 
 	assert(dev != NULL);
 
@@ -469,23 +547,10 @@ __ds1963s_dev_sign_data_page(struct ds1963s_device *dev)
 		dev->scratchpad
 	);
 
-	/* We omit the finalize, as the DS1963S does not use it, but rather
-	 * uses the internal state A, B, C, D, E for the result.  This also
-	 * means we have to subtract the initial state from the context, as
-	 * it has added these to the results.
-	 */
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, M, sizeof M);
+	__ds1963s_dev_sha1(M, H);
 
 	/* Write the results to the scratchpad. */
-	__sha1_get_output_1(
-		dev->scratchpad,
-		ctx.state[0] - 0x67452301,
-		ctx.state[1] - 0xEFCDAB89,
-		ctx.state[2] - 0x98BADCFE,
-		ctx.state[3] - 0x10325476,
-		ctx.state[4] - 0xC3D2E1F0
-	);
+	__sha1_get_output_1(dev->scratchpad, H[0], H[1], H[2], H[3], H[4]);
 
 	dev->prng_counter++;
 
@@ -515,7 +580,7 @@ ds1963s_dev_compute_challenge(struct ds1963s_device *dev)
 	uint8_t  M[64];
 	uint8_t  CC[4];
 	int      page;
-	SHA1_CTX ctx;
+	uint32_t H[5];
 
 	/* The specifications state T4:T0 = 00000b, but this is not actually
 	 * set in the TA1 register, as can be verified with ds1963s-shell.
@@ -541,23 +606,10 @@ ds1963s_dev_compute_challenge(struct ds1963s_device *dev)
 		dev->scratchpad
 	);
 
-	/* We omit the finalize, as the DS1963S does not use it, but rather
-	 * uses the internal state A, B, C, D, E for the result.  This also
-	 * means we have to subtract the initial state from the context, as
-	 * it has added these to the results.
-	 */
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, M, sizeof M);
+	__ds1963s_dev_sha1(M, H);
 
 	/* Write the results to the scratchpad. */
-	__sha1_get_output_1(
-		dev->scratchpad,
-		ctx.state[0] - 0x67452301,
-		ctx.state[1] - 0xEFCDAB89,
-		ctx.state[2] - 0x98BADCFE,
-		ctx.state[3] - 0x10325476,
-		ctx.state[4] - 0xC3D2E1F0
-	);
+	__sha1_get_output_1(dev->scratchpad, H[0], H[1], H[2], H[3], H[4]);
 
 	dev->prng_counter++;
 
@@ -569,7 +621,7 @@ ds1963s_dev_authenticate_host(struct ds1963s_device *dev)
 {
 	uint8_t  M[64];
 	int      page;
-	SHA1_CTX ctx;
+	uint32_t H[5];
 
 	assert(dev != NULL);
 
@@ -588,23 +640,10 @@ ds1963s_dev_authenticate_host(struct ds1963s_device *dev)
 		dev->scratchpad
 	);
 
-	/* We omit the finalize, as the DS1963S does not use it, but rather
-	 * uses the internal state A, B, C, D, E for the result.  This also
-	 * means we have to subtract the initial state from the context, as
-	 * it has added these to the results.
-	 */
-	SHA1_Init(&ctx);
-	SHA1_Update(&ctx, M, sizeof M);
+	__ds1963s_dev_sha1(M, H);
 
 	/* Write the results to the scratchpad. */
-	__sha1_get_output_1(
-		dev->scratchpad,
-		ctx.state[0] - 0x67452301,
-		ctx.state[1] - 0xEFCDAB89,
-		ctx.state[2] - 0x98BADCFE,
-		ctx.state[3] - 0x10325476,
-		ctx.state[4] - 0xC3D2E1F0
-	);
+	__sha1_get_output_1(dev->scratchpad, H[0], H[1], H[2], H[3], H[4]);
 
 	dev->prng_counter++;
 
@@ -669,6 +708,41 @@ ds1963s_dev_rom_command_search_rom(struct ds1963s_device *dev)
 	return 0;
 }
 
+int
+ds1963s_dev_rom_command_read_rom(struct ds1963s_device *dev)
+{
+	uint8_t rom_code[8];
+
+	dev->RC = 0;
+	ds1963s_dev_rom_code_get(dev, rom_code);
+
+	for (int i = 0; i < sizeof(rom_code); i++)
+		DS1963S_TX_BYTE(dev, rom_code[i]);
+
+	return 0;
+}
+
+int
+ds1963s_dev_rom_command_match_rom(struct ds1963s_device *dev)
+{
+	uint8_t rom_code[8], buf[8];
+
+	dev->RC = 0;
+	ds1963s_dev_rom_code_get(dev, rom_code);
+
+	for (int i = 0; i < sizeof(buf); i++)
+		buf[i] = DS1963S_RX_BYTE(dev);
+
+	/* Devices that are not addressed wait for reset. */
+	if (memcmp(buf, rom_code, sizeof buf) != 0) {
+		dev->state = DS1963S_STATE_RESET_WAIT;
+		return -1;
+	}
+
+	dev->RC = 1;
+	return 0;
+}
+
 int
 ds1963s_dev_rom_function(struct ds1963s_device *dev)
 {
@@ -679,28 +753,40 @@ ds1963s_dev_rom_function(struct ds1963s_device *dev)
 	switch (byte) {
 	case 0x33:
 		DEBUG_LOG("[ds1963s|ROM] Read ROM Command\n");
-		fprintf(stderr, "Read ROM Command is not supported\n");
-		exit(EXIT_FAILURE);
+		if (ds1963s_dev_rom_command_read_rom(dev) == -1)
+			return -1;
+
+		dev->state = DS1963S_STATE_MEMORY_FUNCTION;
+		break;
 	case 0x3C:
 		DEBUG_LOG("[ds1963s|ROM] Overdrive skip ROM\n");
-		dev->RC = 0;
-		dev->OD = 1;
+		dev->RC    = 0;
+		dev->OD    = 1;
+		dev->state = DS1963S_STATE_MEMORY_FUNCTION;
 		break;
 	case 0x55:
 		DEBUG_LOG("[ds1963s|ROM] Match ROM Command\n");
-		fprintf(stderr, "Match ROM Command is not supported\n");
-		exit(EXIT_FAILURE);
+		if (ds1963s_dev_rom_command_match_rom(dev) == -1)
+			return -1;
+
+		dev->state = DS1963S_STATE_MEMORY_FUNCTION;
+		break;
 	case 0x69:
 		DEBUG_LOG("[ds1963s|ROM] Overdrive Match Command\n");
-		fprintf(stderr, "Overdrive Match Command is not supported\n");
-		exit(EXIT_FAILURE);
+		if (ds1963s_dev_rom_command_match_rom(dev) == -1)
+			return -1;
+
+		dev->OD    = 1;
+		dev->state = DS1963S_STATE_MEMORY_FUNCTION;
+		break;
 	case 0xA5:
 		DEBUG_LOG("[ds1963s|ROM] Resume\n");
 		ds1963s_dev_rom_command_resume(dev);
 		break;
 	case 0xCC:
 		DEBUG_LOG("[ds1963s|ROM] Skip ROM Command\n");
-		dev->RC = 0;
+		dev->RC    = 0;
+		dev->state = DS1963S_STATE_MEMORY_FUNCTION;
 		break;
 	case 0xF0:
 		DEBUG_LOG("[ds1963s|ROM] Search ROM\n");
@@ -711,6 +797,7 @@ ds1963s_dev_rom_function(struct ds1963s_device *dev)
 		break;
 	default:
 		DEBUG_LOG("[ds1963s|ROM] Unknown command %.2x\n", byte);
+		dev->state = DS1963S_STATE_RESET_WAIT;
 		break;
 	}
 
@@ -759,8 +846,11 @@ ds1963s_dev_memory_command_write_scratchpad(struct ds1963s_device *dev)
 			return ONE_WIRE_BUS_SIGNAL_RESET;
 		}
 
-		if (dev->HIDE == 0)
+		/* E4:E0 track the offset of the last byte written. */
+		if (dev->HIDE == 0) {
 			dev->scratchpad[offset] = byte;
+			dev->ES = (dev->ES & 0xE0) | offset;
+		}
 
 		crc16 = ds1963s_crc16_update_byte(crc16, byte);
 	}
@@ -928,8 +1018,13 @@ ds1963s_dev_memory_command_copy_scratchpad(struct ds1963s_device *dev)
 	if (TA1 != dev->TA1 || TA2 != dev->TA2 || ES != dev->ES)
 		goto error;
 
+	if ((ES & 0x1F) < (addr & 0x1F))
+		goto error;
+
+	/* The bytes from T4:T0 up to and including E4:E0 are copied. */
 	dev->AA = 1;
-	memcpy(&dev->memory[addr], dev->scratchpad, (ES & 0x1F) + 1);
+	memcpy(&dev->memory[addr], &dev->scratchpad[addr & 0x1F],
+	       (ES & 0x1F) - (addr & 0x1F) + 1);
 
 	hexdump(dev->secret_memory, sizeof dev->secret_memory, 0);
 
@@ -1196,15 +1291,22 @@ int ds1963s_dev_power_on(struct ds1963s_device *dev)
 			break;
 		case DS1963S_STATE_RESET_WAIT:
 			DEBUG_LOG("[ds1963s|RESET_WAIT] waiting on reset\n");
-			/* We ignore things until we see a reset pulse. */
-			while (one_wire_bus_member_rx_bit(&dev->bus_slave) != -1)
+			/* We ignore things until we see a reset pulse, and stay
+			 * off the bus until then.
+			 */
+			if (one_wire_bus_member_reset_wait(&dev->bus_slave) ==
+			    ONE_WIRE_BUS_SIGNAL_TERMINATE) {
+				dev->state = DS1963S_STATE_TERMINATED;
 				break;
+			}
 
 			DEBUG_LOG("[ds1963s|RESET_WAIT] Received reset pulse...\n");
 			dev->state = DS1963S_STATE_RESET;
 			break;
 		case DS1963S_STATE_RESET:
 			DEBUG_LOG("[ds1963s|RESET] Waiting for ROM function...\n");
+			if (dev->sync != NULL)
+				dev->sync(dev);
 
 #if 0			/* XXX: hack, we don't hot-add to the topology anyway,
 			 * so for now we don't need this.
@@ -1224,5 +1326,8 @@ int ds1963s_dev_power_on(struct ds1963s_device *dev)
 		}
 	}
 
+	if (dev->sync != NULL)
+		dev->sync(dev);
+
 	return 0;
 }
@@ -33,6 +33,20 @@
 #define DS1963S_STATE_ROM_FUNCTION	3
 #define DS1963S_STATE_MEMORY_FUNCTION	4
 
+/* The device coroutine peaks at around 10 KiB of stack. */
+#define DS1963S_DEV_STACK_SIZE		32768
+
+/* Number of MACs ds1963s_dev_read_auth_page_batch() hashes in one go. */
+#define DS1963S_DEV_AUTH_BATCH		64
+
+/* A Read Authenticated Page MAC computed without touching the device. */
+struct ds1963s_dev_auth_request
+{
+	int		page;		/* Data page 0-15.                */
+	int		secret;		/* Secret 0-7 used in the MAC.    */
+	uint8_t		challenge[3];	/* Scratchpad bytes 20-22.        */
+};
+
 struct ds1963s_device
 {
 	uint8_t		family;
@@ -68,6 +82,12 @@ struct ds1963s_device
 
 	int		state;
 
+	/* If set, called on every reset pulse and when the device stops.
+	 * Memory functions only end there, so memory is consistent.
+	 */
+	void		(*sync)(struct ds1963s_device *);
+	void		*sync_data;
+
 	/* The 1-wire bus the ds1963s is connected to as a slave. */
 	struct one_wire_bus_member bus_slave;
 };
@@ -83,13 +103,23 @@ uint64_t ds1963s_rom_code_get(struct ds1963s_device *dev);
 int   ds1963s_dev_pf_get(struct ds1963s_device *dev);
 void  ds1963s_dev_pf_set(struct ds1963s_device *dev, int pf);
 
+void ds1963s_dev_rom_code_get(struct ds1963s_device *ds1963s, uint8_t buf[8]);
 void ds1963s_dev_connect_bus(struct ds1963s_device *ds1963s, struct one_wire_bus *bus);
 int  ds1963s_dev_power_on(struct ds1963s_device *ds1963s);
 
 void ds1963s_dev_erase_scratchpad(struct ds1963s_device *ds1963s, int address);
 void ds1963s_dev_read_auth_page(struct ds1963s_device *ds1963s, int page);
+void ds1963s_dev_read_auth_page_input(struct ds1963s_device *dev, int page,
+                                      uint32_t W[16]);
+int  ds1963s_dev_read_auth_page_batch(const struct ds1963s_device *dev,
+                                      const struct ds1963s_dev_auth_request *req,
+                                      uint8_t (*mac)[20], size_t count);
 int  ds1963s_dev_sign_data_page(struct ds1963s_device *dev);
 int  ds1963s_dev_validate_data_page(struct ds1963s_device *dev);
+void ds1963s_dev_compute_first_secret(struct ds1963s_device *dev);
+void ds1963s_dev_compute_next_secret(struct ds1963s_device *dev);
+int  ds1963s_dev_compute_challenge(struct ds1963s_device *dev);
+int  ds1963s_dev_authenticate_host(struct ds1963s_device *dev);
 
 #ifdef __cplusplus
 };
@@ -0,0 +1,299 @@
+/* ds1963s-emulator-fuzz.c
+ *
+ * Snapshot based fuzzing of the emulated DS2480B and DS1963S.
+ *
+ * The serial port of the DS2480B is replaced by a transport that hands
+ * out the current fuzz input, and stops the scheduler when it runs dry.
+ * The emulator is brought to the point where the DS2480B waits for its
+ * first command once, and a snapshot is taken there.  Every input then
+ * runs from a restore of that snapshot, so no input sees the effects of
+ * the ones before it, and nothing is set up again in between.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ds1963s-emulator-fuzz.h"
+#include "transport.h"
+
+struct fuzz_input
+{
+	struct coroutine_scheduler *sched;
+	const uint8_t		*data;
+	size_t			size;
+	size_t			pos;
+};
+
+/* Bytes that mean something to the DS2480B or the DS1963S are picked
+ * more often than others, to get further into both state machines.
+ */
+static const uint8_t __fuzz_tokens[] = {
+	0xC1, 0xC5, 0xE1, 0xE3, 0x81, 0x91, 0xA1, 0xB1, 0x0F, 0x33,
+	0x3C, 0x55, 0x5A, 0x69, 0xA5, 0xAA, 0xC3, 0xCC, 0xF0, 0xFF
+};
+
+static volatile unsigned long __fuzz_iteration;
+static uint8_t __fuzz_buf[DS1963S_EMULATOR_FUZZ_INPUT_MAX];
+static volatile size_t __fuzz_size;
+
+static ssize_t
+__fuzz_transport_read(struct transport *t, void *buf, size_t size)
+{
+	struct fuzz_input *in = (struct fuzz_input *)t->private_data;
+
+	/* Out of input, so we stop until the next one is there. */
+	while (in->pos == in->size)
+		coroutine_scheduler_stop(in->sched->current);
+
+	if (size > in->size - in->pos)
+		size = in->size - in->pos;
+
+	memcpy(buf, &in->data[in->pos], size);
+	in->pos += size;
+
+	return size;
+}
+
+static ssize_t
+__fuzz_transport_write(struct transport *t, const void *buf, size_t size)
+{
+	return size;
+}
+
+static struct transport_operations __fuzz_transport_ops = {
+	.read	= __fuzz_transport_read,
+	.write	= __fuzz_transport_write
+};
+
+static uint32_t
+__fuzz_random(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return *state = x;
+}
+
+static size_t
+__fuzz_input_generate(uint8_t *buf, uint32_t *state)
+{
+	size_t size = __fuzz_random(state) % DS1963S_EMULATOR_FUZZ_INPUT_MAX + 1;
+
+	for (size_t i = 0; i < size; i++) {
+		uint32_t r = __fuzz_random(state);
+
+		if (r & 1)
+			buf[i] = r >> 8;
+		else
+			buf[i] = __fuzz_tokens[(r >> 8) % sizeof __fuzz_tokens];
+	}
+
+	return size;
+}
+
+/* Report the input we crashed on, using only async-signal-safe calls. */
+static void
+__fuzz_crash_handler(int sig)
+{
+	static const char hex[] = "0123456789abcdef";
+	char msg[64] = "fuzz input #";
+	char num[24], *p = &num[sizeof num];
+	unsigned long n = __fuzz_iteration;
+	size_t len = strlen(msg);
+
+	do {
+		*--p = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+
+	memcpy(&msg[len], p, &num[sizeof num] - p);
+	len += &num[sizeof num] - p;
+	memcpy(&msg[len], " crashed: ", 10);
+	write(STDERR_FILENO, msg, len + 10);
+
+	for (size_t i = 0; i < __fuzz_size; i++) {
+		char byte[2] = { hex[__fuzz_buf[i] >> 4], hex[__fuzz_buf[i] & 15] };
+		write(STDERR_FILENO, byte, 2);
+	}
+
+	write(STDERR_FILENO, "\n", 1);
+	raise(sig);
+}
+
+static void
+__fuzz_crash_handler_install(void)
+{
+	static uint8_t altstack[65536];
+	static const int signals[] = { SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGSEGV };
+	struct sigaction sa;
+	stack_t ss;
+
+	/* Running off a coroutine stack ends up in its guard page, so we
+	 * handle signals on a stack of our own.
+	 */
+	ss.ss_sp    = altstack;
+	ss.ss_size  = sizeof altstack;
+	ss.ss_flags = 0;
+	sigaltstack(&ss, NULL);
+
+	memset(&sa, 0, sizeof sa);
+	sa.sa_handler = __fuzz_crash_handler;
+	sa.sa_flags   = SA_ONSTACK | SA_RESETHAND;
+	sigemptyset(&sa.sa_mask);
+
+	for (size_t i = 0; i < sizeof signals / sizeof *signals; i++)
+		sigaction(signals[i], &sa, NULL);
+}
+
+/* Add everything the emulated bus topology runs on to 'snap'.  This is
+ * the state of both devices, including the mode and configuration of the
+ * DS2480B, and of the bus, with the coroutines driving them.
+ */
+int
+ds1963s_emulator_snapshot_init(struct snapshot *snap, struct one_wire_bus *bus,
+                               struct ds2480b_device *ds2480b,
+                               struct ds1963s_device *ds1963s)
+{
+	snapshot_init(snap, bus->sched);
+
+	if (snapshot_add(snap, bus, sizeof *bus) == -1                     ||
+	    snapshot_add(snap, ds2480b, sizeof *ds2480b) == -1             ||
+	    snapshot_add(snap, ds1963s, sizeof *ds1963s) == -1             ||
+	    snapshot_add_coroutine(snap, &bus->coro) == -1                 ||
+	    snapshot_add_coroutine(snap, &ds2480b->bus_master.coro) == -1 ||
+	    snapshot_add_coroutine(snap, &ds1963s->bus_slave.coro) == -1) {
+		snapshot_destroy(snap);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Put 'count' stacks for every coroutine of the emulated bus topology in
+ * the pool of 'sched', with their pages faulted in.  This has to happen
+ * before one_wire_bus_init(), as the bus takes its stack there.
+ */
+int
+ds1963s_emulator_stack_reserve(struct coroutine_scheduler *sched,
+                               const struct ds2480b_device *ds2480b,
+                               const struct ds1963s_device *ds1963s,
+                               size_t count)
+{
+	if (coroutine_scheduler_stack_reserve(sched, ONE_WIRE_BUS_STACK_SIZE,
+	                                      count) == -1)
+		return -1;
+
+	if (coroutine_scheduler_stack_reserve(sched,
+	                                      ds2480b->bus_master.stack_size,
+	                                      count) == -1)
+		return -1;
+
+	return coroutine_scheduler_stack_reserve(sched,
+	                                         ds1963s->bus_slave.stack_size,
+	                                         count);
+}
+
+/* Run 'iterations' pseudo-random inputs derived from 'seed' through the
+ * DS2480B serial port, starting every one of them on 'ds1963s' as it is
+ * passed in.  'stacks' is passed to ds1963s_emulator_stack_reserve().
+ * The bus 'ds1963s' is connected to is gone afterwards, so it can only
+ * be destroyed.
+ */
+int
+ds1963s_emulator_fuzz(struct ds1963s_device *ds1963s, unsigned long iterations,
+                      uint32_t seed, size_t stacks)
+{
+	static const uint8_t calibration = 0xC1;
+	struct coroutine_scheduler sched;
+	struct ds2480b_device ds2480b;
+	struct one_wire_bus bus;
+	struct transport serial;
+	struct fuzz_input in;
+	struct snapshot snap;
+	struct timespec start, end;
+	uint32_t state = seed ?: 1;
+	double elapsed;
+	int ret = -1;
+
+	coroutine_scheduler_init(&sched);
+	ds2480b_dev_init(&ds2480b);
+
+	if (ds1963s_emulator_stack_reserve(&sched, &ds2480b, ds1963s,
+	                                   stacks) == -1)
+		goto out;
+
+	one_wire_bus_init(&bus, &sched);
+
+	memset(&serial, 0, sizeof serial);
+	serial.private_data = &in;
+	serial.t_ops        = &__fuzz_transport_ops;
+	ds2480b_dev_connect_serial(&ds2480b, &serial);
+
+	if (ds2480b_dev_bus_connect(&ds2480b, &bus) == -1)
+		goto out;
+
+	ds1963s_dev_connect_bus(ds1963s, &bus);
+
+	/* Run up to the first DS2480B command as our baseline. */
+	in.sched = &sched;
+	in.data  = &calibration;
+	in.size  = 1;
+	in.pos   = 0;
+	if (one_wire_bus_run(&bus) != 1)
+		goto out;
+
+	if (ds1963s_emulator_snapshot_init(&snap, &bus, &ds2480b, ds1963s) == -1)
+		goto out;
+
+	snapshot_take(&snap);
+	__fuzz_crash_handler_install();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (__fuzz_iteration = 0; __fuzz_iteration < iterations;
+	     __fuzz_iteration++) {
+		__fuzz_size = __fuzz_input_generate(__fuzz_buf, &state);
+
+		in.data = __fuzz_buf;
+		in.size = __fuzz_size;
+		in.pos  = 0;
+		if (one_wire_bus_run(&bus) == -1)
+			goto out_snapshot;
+
+		snapshot_restore(&snap);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = (end.tv_sec - start.tv_sec) +
+	          (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%lu inputs in %.3f seconds (%.0f inputs/s)\n",
+	       iterations, elapsed, iterations / elapsed);
+	ret = 0;
+
+out_snapshot:
+	snapshot_destroy(&snap);
+out:
+	coroutine_scheduler_destroy(&sched);
+	return ret;
+}
@@ -0,0 +1,54 @@
+/* ds1963s-emulator-fuzz.h
+ *
+ * Snapshot based fuzzing of the emulated DS2480B and DS1963S.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_EMULATOR_FUZZ_H
+#define DS1963S_EMULATOR_FUZZ_H
+
+#include <inttypes.h>
+#include "1-wire-bus.h"
+#include "ds1963s-device.h"
+#include "ds2480b-device.h"
+#include "snapshot.h"
+
+/* Largest input the fuzz loop sends to the DS2480B. */
+#define DS1963S_EMULATOR_FUZZ_INPUT_MAX	256
+
+/* Stacks pre-faulted for every coroutine of the emulated topology. */
+#define DS1963S_EMULATOR_STACKS_DEFAULT	1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ds1963s_emulator_snapshot_init(struct snapshot *, struct one_wire_bus *,
+                                   struct ds2480b_device *,
+                                   struct ds1963s_device *);
+int ds1963s_emulator_stack_reserve(struct coroutine_scheduler *,
+                                   const struct ds2480b_device *,
+                                   const struct ds1963s_device *, size_t);
+int ds1963s_emulator_fuzz(struct ds1963s_device *, unsigned long, uint32_t,
+                          size_t);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -1,6 +1,7 @@
 /* ds1963s-emulator-yaml.c
  *
- * Parse a yaml configuration defining the ds1963s ibutton to emulate.
+ * Parse and emit a yaml configuration defining the ds1963s ibutton to
+ * emulate.
  *
  * Dedicated to Yuzuyu Arielle Huizer.
  *
@@ -25,6 +26,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <ctype.h>
+#include <stdarg.h>
 #include <yaml.h>
 #include "ds1963s-common.h"
 #include "ds1963s-device.h"
@@ -687,3 +689,157 @@ ds1963s_emulator_yaml_load(struct ds1963s_device *dev, const char *pathname)
 
 	return 0;
 }
+
+static void
+__yaml_emitter_error(yaml_emitter_t *emitter, yaml_event_t *event)
+{
+	fprintf(stderr, "Failed to emit event %d: %s\n", event->type,
+	                                                 emitter->problem);
+	yaml_emitter_delete(emitter);
+	exit(EXIT_FAILURE);
+}
+
+static void
+__yaml_emit(yaml_emitter_t *emitter, yaml_event_t *event)
+{
+	if (!yaml_emitter_emit(emitter, event))
+		__yaml_emitter_error(emitter, event);
+}
+
+static void
+__yaml_start_map(yaml_emitter_t *emitter)
+{
+	yaml_event_t event;
+
+	yaml_mapping_start_event_initialize(&event, NULL,
+		(yaml_char_t *)YAML_MAP_TAG, 1, YAML_ANY_MAPPING_STYLE);
+	__yaml_emit(emitter, &event);
+}
+
+static void
+__yaml_end_map(yaml_emitter_t *emitter)
+{
+	yaml_event_t event;
+
+	yaml_mapping_end_event_initialize(&event);
+	__yaml_emit(emitter, &event);
+}
+
+static void
+__yaml_add_tag(yaml_emitter_t *emitter, const char *tag, const char *fmt,
+               va_list ap)
+{
+	yaml_event_t event;
+	char buf[128];
+
+	vsnprintf(buf, sizeof buf, fmt, ap);
+	yaml_scalar_event_initialize(&event, NULL, (yaml_char_t *)tag,
+		(yaml_char_t *)buf, strlen(buf), 1, 0, YAML_PLAIN_SCALAR_STYLE);
+	__yaml_emit(emitter, &event);
+}
+
+static void
+__yaml_add_int(yaml_emitter_t *emitter, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	__yaml_add_tag(emitter, YAML_INT_TAG, fmt, ap);
+	va_end(ap);
+}
+
+static void
+__yaml_add_string(yaml_emitter_t *emitter, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	__yaml_add_tag(emitter, YAML_STR_TAG, fmt, ap);
+	va_end(ap);
+}
+
+static void
+__yaml_add_hex(yaml_emitter_t *emitter, const uint8_t *buf, size_t size)
+{
+	char hex[128];
+
+	assert(size * 2 < sizeof hex);
+
+	for (size_t i = 0; i < size; i++)
+		snprintf(&hex[i * 2], sizeof(hex) - i * 2, "%.2x", buf[i]);
+
+	__yaml_add_string(emitter, "%s", hex);
+}
+
+/* Emit the configuration of 'dev' in the format that
+ * ds1963s_emulator_yaml_load() reads, and ds1963s-tool dumps.
+ */
+int
+ds1963s_emulator_yaml_save(const struct ds1963s_device *dev, FILE *fp)
+{
+	yaml_emitter_t emitter;
+	yaml_event_t event;
+	uint8_t rom[7], serial[6];
+
+	yaml_emitter_initialize(&emitter);
+	yaml_emitter_set_output_file(&emitter, fp);
+
+	yaml_stream_start_event_initialize(&event, YAML_UTF8_ENCODING);
+	__yaml_emit(&emitter, &event);
+	yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1);
+	__yaml_emit(&emitter, &event);
+	__yaml_start_map(&emitter);
+
+	/* The serial is presented MSB first. */
+	rom[0] = dev->family;
+	memcpy(&rom[1], dev->serial, sizeof dev->serial);
+	for (int i = 0; i < sizeof serial; i++)
+		serial[i] = dev->serial[sizeof(serial) - 1 - i];
+
+	__yaml_add_string(&emitter, "family");
+	__yaml_add_int(&emitter, "0x%.2x", dev->family);
+	__yaml_add_string(&emitter, "serial");
+	__yaml_add_hex(&emitter, serial, sizeof serial);
+	__yaml_add_string(&emitter, "crc8");
+	__yaml_add_int(&emitter, "0x%.2x", ds1963s_crc8(rom, sizeof rom));
+
+	__yaml_add_string(&emitter, "write_cycle_counters");
+	__yaml_start_map(&emitter);
+	for (int i = 0; i < 8; i++) {
+		__yaml_add_string(&emitter, "data_page_%.2d", i + 8);
+		__yaml_add_int(&emitter, "0x%.8x", dev->data_wc[i]);
+	}
+	for (int i = 0; i < 8; i++) {
+		__yaml_add_string(&emitter, "secret_%d", i);
+		__yaml_add_int(&emitter, "0x%.8x", dev->secret_wc[i]);
+	}
+	__yaml_end_map(&emitter);
+
+	__yaml_add_string(&emitter, "nvram");
+	__yaml_start_map(&emitter);
+	for (int i = 0; i < 16; i++) {
+		__yaml_add_string(&emitter, "page_%.2d", i);
+		__yaml_add_hex(&emitter, &dev->data_memory[i * 32], 32);
+	}
+	__yaml_end_map(&emitter);
+
+	__yaml_add_string(&emitter, "prng_counter");
+	__yaml_add_int(&emitter, "0x%.8x", dev->prng_counter);
+
+	__yaml_add_string(&emitter, "secrets");
+	__yaml_start_map(&emitter);
+	for (int i = 0; i < 8; i++) {
+		__yaml_add_string(&emitter, "secret_%d", i);
+		__yaml_add_hex(&emitter, &dev->secret_memory[i * 8], 8);
+	}
+	__yaml_end_map(&emitter);
+
+	__yaml_end_map(&emitter);
+	yaml_document_end_event_initialize(&event, 1);
+	__yaml_emit(&emitter, &event);
+	yaml_stream_end_event_initialize(&event);
+	__yaml_emit(&emitter, &event);
+	yaml_emitter_delete(&emitter);
+
+	return 0;
+}
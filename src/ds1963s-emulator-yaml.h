@@ -22,6 +22,7 @@
 #ifndef DS1963S_EMULATOR_YAML
 #define DS1963S_EMULATOR_YAML
 
+#include <stdio.h>
 #include "ds1963s-device.h"
 
 #ifdef __cplusplus
@@ -29,6 +30,7 @@ extern "C" {
 #endif
 
 int ds1963s_emulator_yaml_load(struct ds1963s_device *dev, const char *pathname);
+int ds1963s_emulator_yaml_save(const struct ds1963s_device *dev, FILE *fp);
 
 #ifdef __cplusplus
 };
@@ -23,7 +23,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <unistd.h>
 #include "ds1963s-device.h"
+#include "ds1963s-emulator-fuzz.h"
+#include "ds1963s-image.h"
 #include "ds2480b-device.h"
 #include "transport-factory.h"
 #include "transport-pty.h"
@@ -38,11 +41,15 @@
 static const struct option options[] = {
 	{ "config",             1,      NULL,   'c' },
 	{ "device",             1,      NULL,   'd' },
+	{ "fuzz",               1,      NULL,   'f' },
 	{ "help",               0,      NULL,   'h' },
+	{ "image",              1,      NULL,   'i' },
+	{ "seed",               1,      NULL,   's' },
+	{ "stacks",             1,      NULL,   'S' },
 	{ "transport",		1,	NULL,	't' }
 };
 
-const char optstr[] = "c:d:ht:";
+const char optstr[] = "c:d:f:hi:s:S:t:";
 
 void usage(const char *progname)
 {
@@ -51,7 +58,17 @@ void usage(const char *progname)
 	                "use.\n");
 	fprintf(stderr, "   -d --device=pathname  the unix socket to use as "
 	                "serial device.\n");
+	fprintf(stderr, "   -f --fuzz=count       run count random inputs "
+	                "from a snapshot.\n");
 	fprintf(stderr, "   -h --help             display the help menu.\n");
+	fprintf(stderr, "   -i --image=pathname   the memory image to keep "
+	                "the state in.\n");
+	fprintf(stderr, "                         --config only sets up a "
+	                "new image.\n");
+	fprintf(stderr, "   -s --seed=seed        the seed for --fuzz "
+	                "inputs.\n");
+	fprintf(stderr, "   -S --stacks=count     coroutine stacks to "
+	                "pre-fault per device.\n");
 	fprintf(stderr, "   -t --transport        transport to use.\n");
 }
 
@@ -61,14 +78,23 @@ int main(int argc, char **argv)
 	struct ds2480b_device ds2480b;
 	struct transport *serial;
 	struct one_wire_bus bus;
+	struct coroutine_scheduler sched;
 	const char *config_name;
 	const char *device_name;
+	const char *image_name;
 	const char *transport;
+	unsigned long fuzz;
+	size_t stacks;
+	uint32_t seed;
 	int i, o;
 
 	config_name = NULL;
 	device_name = UNIX_SOCKET_PATH;
+	image_name  = NULL;
 	transport   = "unix";
+	fuzz        = 0;
+	seed        = 1;
+	stacks      = DS1963S_EMULATOR_STACKS_DEFAULT;
 	while ( (o = getopt_long(argc, argv, optstr, options, &i)) != -1) {
 		switch (o) {
 		case 'c':
@@ -77,16 +103,37 @@ int main(int argc, char **argv)
 		case 'd':
 			device_name = optarg;
 			break;
+		case 'f':
+			fuzz = strtoul(optarg, NULL, 0);
+			break;
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
+		case 'i':
+			image_name = optarg;
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			stacks = strtoul(optarg, NULL, 0);
+			break;
 		case 't':
 			transport = optarg;
 			break;
 		}
 	}
 
-	one_wire_bus_init(&bus);
+	/* An existing image holds the state, and would silently replace
+	 * anything we load from a configuration.
+	 */
+	if (config_name != NULL && image_name != NULL &&
+	    access(image_name, F_OK) == 0) {
+		fprintf(stderr, "Image `%s' already exists, and cannot be "
+		                "used with --config.\n", image_name);
+		exit(EXIT_FAILURE);
+	}
+
 	ds1963s_dev_init(&ds1963s);
 	ds2480b_dev_init(&ds2480b);
 
@@ -101,6 +148,45 @@ int main(int argc, char **argv)
 #endif
 	}
 
+	/* A new image starts out with the configuration. */
+	if (image_name != NULL && access(image_name, F_OK) == -1) {
+		if (ds1963s_image_create(image_name, &ds1963s) == -1) {
+			perror("ds1963s_image_create()");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/* The fuzz loop starts from the image, but never writes to it. */
+	if (fuzz != 0) {
+		if (image_name != NULL &&
+		    ds1963s_image_load(&ds1963s, image_name) == -1) {
+			fprintf(stderr, "Could not load image `%s'.\n",
+			        image_name);
+			exit(EXIT_FAILURE);
+		}
+
+		if (ds1963s_emulator_fuzz(&ds1963s, fuzz, seed, stacks) == -1) {
+			fprintf(stderr, "Could not run the fuzz loop.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		exit(EXIT_SUCCESS);
+	}
+
+	if (image_name != NULL &&
+	    ds1963s_image_attach(&ds1963s, image_name) == -1) {
+		fprintf(stderr, "Could not attach image `%s'.\n", image_name);
+		exit(EXIT_FAILURE);
+	}
+
+	coroutine_scheduler_init(&sched);
+	if (ds1963s_emulator_stack_reserve(&sched, &ds2480b, &ds1963s,
+	                                   stacks) == -1) {
+		perror("ds1963s_emulator_stack_reserve()");
+		exit(EXIT_FAILURE);
+	}
+	one_wire_bus_init(&bus, &sched);
+
 	if ( (serial = transport_factory_new_by_name(transport)) == NULL) {
 		perror("transport_factory_new()");
 		exit(EXIT_FAILURE);
@@ -132,5 +218,8 @@ int main(int argc, char **argv)
 	/* Run the whole emulated bus topology. */
 	one_wire_bus_run(&bus);
 
+	if (image_name != NULL)
+		ds1963s_image_detach(&ds1963s);
+
 	transport_destroy(serial);
 }
@@ -0,0 +1,101 @@
+/* ds1963s-image-convert.c
+ *
+ * Convert between ds1963s emulator memory images and yaml configurations.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include "ds1963s-device.h"
+#include "ds1963s-emulator-yaml.h"
+#include "ds1963s-image.h"
+
+#define PROGNAME	"ds1963s-image-convert"
+
+static const struct option options[] = {
+	{ "config",             1,      NULL,   'c' },
+	{ "help",               0,      NULL,   'h' },
+	{ "image",              1,      NULL,   'i' }
+};
+
+const char optstr[] = "c:hi:";
+
+void usage(const char *progname)
+{
+	fprintf(stderr, "Use as: %s [OPTION]\n", progname ?: PROGNAME);
+	fprintf(stderr, "   -c --config=pathname  the configuration to write "
+	                "to the image.\n");
+	fprintf(stderr, "   -h --help             display the help menu.\n");
+	fprintf(stderr, "   -i --image=pathname   the image to convert.\n");
+	fprintf(stderr, "\nWithout --config the image is written to stdout "
+	                "as a configuration.\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct ds1963s_device ds1963s;
+	const char *config_name;
+	const char *image_name;
+	int i, o;
+
+	config_name = NULL;
+	image_name  = NULL;
+	while ( (o = getopt_long(argc, argv, optstr, options, &i)) != -1) {
+		switch (o) {
+		case 'c':
+			config_name = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(EXIT_SUCCESS);
+		case 'i':
+			image_name = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (image_name == NULL) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	ds1963s_dev_init(&ds1963s);
+
+	if (config_name != NULL) {
+		ds1963s_emulator_yaml_load(&ds1963s, config_name);
+
+		if (ds1963s_image_create(image_name, &ds1963s) == -1) {
+			perror("ds1963s_image_create()");
+			exit(EXIT_FAILURE);
+		}
+
+		exit(EXIT_SUCCESS);
+	}
+
+	if (ds1963s_image_load(&ds1963s, image_name) == -1) {
+		fprintf(stderr, "Could not load image `%s'.\n", image_name);
+		exit(EXIT_FAILURE);
+	}
+
+	ds1963s_emulator_yaml_save(&ds1963s, stdout);
+	exit(EXIT_SUCCESS);
+}
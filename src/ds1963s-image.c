@@ -0,0 +1,181 @@
+/* ds1963s-image.c
+ *
+ * Memory images backing the state of an emulated DS1963S.
+ *
+ * An attached image is mapped shared, and the memory of the device is
+ * copied into it whenever it changed by the next reset pulse.  Memory
+ * functions only end on a reset, so the image always holds the state
+ * between two of them, which msync() then puts on disk.  Loading an
+ * image is a single copy, without any parsing.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "ds1963s-image.h"
+
+static void
+__ds1963s_image_get(struct ds1963s_image *image,
+                    const struct ds1963s_device *dev)
+{
+	memset(image, 0, sizeof *image);
+	memcpy(image->magic, DS1963S_IMAGE_MAGIC, sizeof DS1963S_IMAGE_MAGIC);
+	image->version = DS1963S_IMAGE_VERSION;
+	image->family  = dev->family;
+	memcpy(image->serial, dev->serial, sizeof image->serial);
+	memcpy(image->memory, dev->memory, sizeof image->memory);
+}
+
+static int
+__ds1963s_image_put(struct ds1963s_device *dev,
+                    const struct ds1963s_image *image)
+{
+	if (memcmp(image->magic, DS1963S_IMAGE_MAGIC,
+	           sizeof DS1963S_IMAGE_MAGIC) != 0)
+		return -1;
+
+	if (image->version != DS1963S_IMAGE_VERSION)
+		return -1;
+
+	dev->family = image->family;
+	memcpy(dev->serial, image->serial, sizeof dev->serial);
+	memcpy(dev->memory, image->memory, sizeof dev->memory);
+
+	return 0;
+}
+
+static void
+__ds1963s_image_sync(struct ds1963s_device *dev)
+{
+	struct ds1963s_image *image = (struct ds1963s_image *)dev->sync_data;
+
+	if (memcmp(image->memory, dev->memory, sizeof image->memory) == 0)
+		return;
+
+	memcpy(image->memory, dev->memory, sizeof image->memory);
+	if (msync(image, sizeof *image, MS_SYNC) == -1)
+		perror("msync()");
+}
+
+/* Write the state of 'dev' to a new image at 'pathname'. */
+int
+ds1963s_image_create(const char *pathname, const struct ds1963s_device *dev)
+{
+	struct ds1963s_image image;
+	int fd;
+
+	assert(pathname != NULL);
+	assert(dev != NULL);
+
+	__ds1963s_image_get(&image, dev);
+
+	if ( (fd = open(pathname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) == -1)
+		return -1;
+
+	if (write(fd, &image, sizeof image) != sizeof image) {
+		close(fd);
+		return -1;
+	}
+
+	if (fsync(fd) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	return close(fd);
+}
+
+/* Load the image at 'pathname' into 'dev', without attaching it. */
+int
+ds1963s_image_load(struct ds1963s_device *dev, const char *pathname)
+{
+	struct ds1963s_image image;
+	int fd;
+
+	assert(dev != NULL);
+	assert(pathname != NULL);
+
+	if ( (fd = open(pathname, O_RDONLY)) == -1)
+		return -1;
+
+	if (read(fd, &image, sizeof image) != sizeof image) {
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return __ds1963s_image_put(dev, &image);
+}
+
+/* Load the image at 'pathname' into 'dev', and keep it in sync with the
+ * memory of 'dev' from then on.
+ */
+int
+ds1963s_image_attach(struct ds1963s_device *dev, const char *pathname)
+{
+	struct ds1963s_image *image;
+	struct stat st;
+	int fd;
+
+	assert(dev != NULL);
+	assert(pathname != NULL);
+	assert(dev->sync == NULL);
+
+	if ( (fd = open(pathname, O_RDWR)) == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1 || st.st_size != sizeof *image) {
+		close(fd);
+		return -1;
+	}
+
+	image = mmap(NULL, sizeof *image, PROT_READ | PROT_WRITE,
+	             MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (image == MAP_FAILED)
+		return -1;
+
+	if (__ds1963s_image_put(dev, image) == -1) {
+		munmap(image, sizeof *image);
+		return -1;
+	}
+
+	dev->sync      = __ds1963s_image_sync;
+	dev->sync_data = image;
+
+	return 0;
+}
+
+void
+ds1963s_image_detach(struct ds1963s_device *dev)
+{
+	assert(dev != NULL);
+	assert(dev->sync == __ds1963s_image_sync);
+
+	__ds1963s_image_sync(dev);
+	munmap(dev->sync_data, sizeof(struct ds1963s_image));
+
+	dev->sync      = NULL;
+	dev->sync_data = NULL;
+}
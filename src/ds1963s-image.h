@@ -0,0 +1,58 @@
+/* ds1963s-image.h
+ *
+ * Memory images backing the state of an emulated DS1963S.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef DS1963S_IMAGE_H
+#define DS1963S_IMAGE_H
+
+#include <inttypes.h>
+#include "ds1963s-device.h"
+
+#define DS1963S_IMAGE_MAGIC	"DS1963S"
+#define DS1963S_IMAGE_VERSION	1
+
+/* The layout of an image file.  'memory' is the memory union of the
+ * device as is, so the write cycle and PRNG counters are in host byte
+ * order.
+ */
+struct ds1963s_image
+{
+	char		magic[8];
+	uint32_t	version;
+	uint8_t		family;
+	uint8_t		serial[6];
+	uint8_t		reserved;
+	uint8_t		memory[1024];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int  ds1963s_image_create(const char *, const struct ds1963s_device *);
+int  ds1963s_image_load(struct ds1963s_device *, const char *);
+int  ds1963s_image_attach(struct ds1963s_device *, const char *);
+void ds1963s_image_detach(struct ds1963s_device *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -25,6 +25,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
@@ -45,22 +46,24 @@
 #define MODE_SECRET_FIRST_SET		128
 #define MODE_SECRET_NEXT_SET		256
 #define MODE_VALIDATE_DATA_PAGE		512
+#define MODE_CAPTURE			1024
+#define MODE_CRACK			2048
 
 #define FORMAT_TEXT			1
 #define FORMAT_YAML			2
 
 int
-ds1963s_tool_init(struct ds1963s_tool *tool, const char *device)
+ds1963s_tool_init(struct ds1963s_tool *tool, const char *device, int baudrate)
 {
 	memset(tool, 0, sizeof *tool);
-	ds1963s_dev_init(&tool->brute.dev);
-	return ds1963s_client_init(&tool->client, device);
+	ds1963s_brute_init(&tool->brute);
+	return ds1963s_client_init_baudrate(&tool->client, device, baudrate);
 }
 
 void
 ds1963s_tool_destroy(struct ds1963s_tool *tool)
 {
-	ds1963s_dev_destroy(&tool->brute.dev);
+	ds1963s_brute_destroy(&tool->brute);
 	ds1963s_client_destroy(&tool->client);
 }
 
@@ -71,46 +74,27 @@ ds1963s_tool_fatal(struct ds1963s_tool *tool)
 	exit(EXIT_FAILURE);
 }
 
+/* Read the HMAC of 'secret' over its data page.  The HIDE flag has to be
+ * clear, or the scratchpad cannot be read back.
+ */
 int
-ds1963s_tool_secret_hmac_target_get(
+ds1963s_tool_secret_hmac_get(
 	struct ds1963s_tool *tool,
 	int secret,
-	int link)
+	uint8_t hmac[20])
 {
 	ds1963s_client_read_auth_page_reply_t auth_reply;
 	ds1963s_client_sp_read_reply_t sp_reply;
-	struct ds1963s_brute *brute;
-	int addr, ret;
+	int addr;
 
 	assert(tool != NULL);
-	assert(secret >= 0 && secret <= 8);
-	assert(link >= 0 && link <= 3);
-
-       	brute = &tool->brute;
-	/* Only link 0 is not destructive.  The other 3 links need a partial
-	 * overwrite to make things work.
-	 */
-	if (link != 0) {
-		ret = ds1963s_client_secret_write(
-			&tool->client,		/* DS1963S context         */
-			secret,			/* Secret number           */
-			"\0\0\0\0\0\0\0\0",	/* Partial secret to write */
-			link * 2		/* Length of the secret    */
-		);
-
-		if (ret == -1)
-			return -1;
-	}
+	assert(secret >= 0 && secret < 8);
 
 	/* Calculate the address of this secret. */
 	addr = ds1963s_client_page_to_address(&tool->client, secret);
 	if (addr == -1)
 		return -1;
 
-	/* Erase the scratchpad. */
-	if (ds1963s_client_sp_erase(&tool->client, 0) == -1)
-		return -1;
-
 	/* Read auth. page over the current scratchpad/data/etc. */
 	if (ds1963s_client_read_auth(&tool->client, addr, &auth_reply) == -1)
 		return -1;
@@ -118,56 +102,35 @@ ds1963s_tool_secret_hmac_target_get(
 	if (ds1963s_client_sp_read(&tool->client, &sp_reply) == -1)
 		return -1;
 
-	memcpy(brute->secrets[secret].target_hmac[link], &sp_reply.data[8], 20);
+	memcpy(hmac, &sp_reply.data[8], 20);
 	return 0;
 }
 
-void *
-ds1963s_tool_brute_link(struct ds1963s_tool *tool, int secret, int link)
+/* Partially overwrite the even 'secret' and the odd secret following it
+ * for 'link'.  The last link * width bytes of 'secret' and the first
+ * link * width bytes of the next secret are adjacent in secret memory, so
+ * a single copy, and a single power cycle, serves both.
+ */
+int
+ds1963s_tool_secret_pair_link_write(
+	struct ds1963s_tool *tool,
+	int secret,
+	int link)
 {
-	struct ds1963s_brute_secret *secret_state;
-	struct ds1963s_brute *brute;
-	struct ds1963s_device *dev;
-	int i;
-
- 	brute = &tool->brute;
-
-	assert(brute != NULL);
-	assert(secret >= 0 && secret <= 8);
-	assert(link >= 0 && link <= 3);
-
- 	secret_state = &brute->secrets[secret];
-	dev          = &brute->dev;
-
-	/* Set the secret to 0. */
-	memset(&dev->secret_memory[secret * 8], 0, 8);
-
-	/* Copy the known part of the secret out for this link type. */
-	memcpy(&dev->secret_memory[secret * 8 + link * 2],
-	       &secret_state->secret[link * 2],
-	       8 - link * 2);
-
-	for (i = 0; i < 65536; i++) {
-		int index = secret * 8 + link * 2;
+	static const uint8_t zero[16];
+	int len, addr;
 
-		dev->secret_memory[index]     = (i >> 0) & 0xFF;
-		dev->secret_memory[index + 1] = (i >> 8) & 0xFF;
-
-		ds1963s_dev_read_auth_page(dev, secret);
-
-		if (!memcmp(secret_state->target_hmac[link], &dev->scratchpad[8], 20)) {
-			secret_state->secret[link * 2] = (i >>  0) & 0xFF;
-			secret_state->secret[link * 2 + 1] = (i >>  8) & 0xFF;
-			break;
-		}
+	assert(tool != NULL);
+	assert(secret >= 0 && secret < 8 && secret % 2 == 0);
+	assert(link > 0 && link < ds1963s_brute_links(tool->brute.width));
 
-		memset(dev->scratchpad, 0xFF, 32);
-	}
+	len  = link * tool->brute.width;
+	addr = 0x200 + (secret + 1) * 8 - len;
 
-	return NULL;
+	return ds1963s_client_secret_write_address(&tool->client, addr,
+	                                           zero, 2 * len);
 }
 
-
 void
 ds1963s_tool_memory_dump_text(struct ds1963s_tool *tool)
 {
@@ -273,17 +236,37 @@ ds1963s_tool_info_full_disclaimer(void)
 }
 
 void
-xds1963s_tool_secret_hmac_target_get(
+xds1963s_tool_secret_hmac_get(
+	struct ds1963s_tool *tool,
+	int secret,
+	uint8_t hmac[20])
+{
+	if (ds1963s_tool_secret_hmac_get(tool, secret, hmac) == -1) {
+		ds1963s_client_perror(&tool->client,
+			"ds1963s_tool_secret_hmac_get()");
+		ds1963s_tool_fatal(tool);
+	}
+}
+
+void
+xds1963s_tool_secret_pair_link_write(
 	struct ds1963s_tool *tool,
 	int secret,
 	int link)
 {
-	int ret;
+	if (ds1963s_tool_secret_pair_link_write(tool, secret, link) == -1) {
+		ds1963s_client_perror(&tool->client,
+			"ds1963s_tool_secret_pair_link_write()");
+		ds1963s_tool_fatal(tool);
+	}
+}
 
-	ret = ds1963s_tool_secret_hmac_target_get(tool, secret, link);
-	if (ret == -1) {
+void
+xds1963s_client_sp_erase(struct ds1963s_tool *tool)
+{
+	if (ds1963s_client_sp_erase(&tool->client, 0) == -1) {
 		ds1963s_client_perror(&tool->client,
-			"ds1963s_tool_secret_hmac_target_get()");
+			"ds1963s_client_sp_erase()");
 		ds1963s_tool_fatal(tool);
 	}
 }
@@ -316,57 +299,146 @@ xds1963s_client_secret_write(struct ds1963s_tool *tool,
 	}
 }
 
+/* Pick the link width from the time a power cycle takes on this DS1963S,
+ * which dominates the cost of a partial overwrite, and the local hash rate.
+ */
 void
-ds1963s_tool_secrets_get(struct ds1963s_tool *tool,
-                         struct ds1963s_rom *rom,
-                         uint32_t counters[16])
+ds1963s_tool_width_auto(struct ds1963s_tool *tool)
 {
-	uint8_t buf[256];
-	uint8_t data[32];
+	struct timespec start_time, end_time;
+	double latency, rate;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	if (ds1963s_client_hide_set(&tool->client) == -1) {
+		ds1963s_client_perror(&tool->client, "ds1963s_client_hide_set()");
+		ds1963s_tool_fatal(tool);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+	/* Clear the HIDE flag again. */
+	if (ds1963s_client_sp_erase(&tool->client, 0) == -1) {
+		ds1963s_client_perror(&tool->client, "ds1963s_client_sp_erase()");
+		ds1963s_tool_fatal(tool);
+	}
+
+	latency = (end_time.tv_sec - start_time.tv_sec) +
+	          (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+	rate    = ds1963s_brute_rate(&tool->brute);
+
+	tool->brute.width = ds1963s_brute_width_auto(latency, rate);
+
+	if (tool->verbose) {
+		fprintf(stderr, "Write latency %.2fs, hash rate %.2f MH/s: "
+		                "using a link width of %d.\n", latency,
+		                rate / 1e6, tool->brute.width);
+	}
+}
+
+/* Capture everything needed to recover the secrets offline.  This
+ * partially overwrites all secrets on the DS1963S.
+ */
+void
+ds1963s_tool_capture(struct ds1963s_tool *tool,
+                     struct ds1963s_rom *rom,
+                     uint32_t counters[16],
+                     struct ds1963s_capture *capture)
+{
+	int links, power_cycles;
+
+	if (tool->width_auto)
+		ds1963s_tool_width_auto(tool);
+
+	links = ds1963s_brute_links(tool->brute.width);
+	capture->width = tool->brute.width;
 
-	/* Initialize the brute forcer state. */
 	for (int i = 0; i < 8; i++) {
 		xds1963s_client_memory_read(
 			tool,
 			32 * i,
-			&buf[32 * i],
+			capture->data[i],
 			32
 		);
 	}
 
-	memcpy(tool->brute.dev.serial, &rom->raw[1], 6);
-	memcpy(tool->brute.dev.data_memory, buf, sizeof buf);
-
-	/* Initialize the write cycle counters. */
-	for (int i = 0; i < 8; i++) {
-		tool->brute.dev.data_wc[i]   = counters[i];
-		tool->brute.dev.secret_wc[i] = counters[i + 8];
-	}
+	memcpy(capture->rom, rom->raw, sizeof capture->rom);
+	memcpy(capture->counters, counters, sizeof capture->counters);
 
 	if (tool->verbose)
 		fprintf(stderr, "\n01. Calculating HMAC links.\n");
 
+	memset(capture->target_hmac, 0, sizeof capture->target_hmac);
+	power_cycles = tool->client.power_cycles;
+
+	/* Link 0 is not destructive, so read it for all secrets in one go
+	 * before anything is overwritten.
+	 */
+	if (tool->verbose)
+		fprintf(stderr, "    Link 0 of all secrets\n");
+
+	/* Read Authenticated Page leaves its MAC in the scratchpad, and
+	 * also hashes part of it.  The brute forcer assumes an erased
+	 * scratchpad, so we erase it before every read.
+	 */
 	for (int secret = 0; secret < 8; secret++) {
-		for (int link = 0; link < 4; link++) {
+		xds1963s_client_sp_erase(tool);
+		xds1963s_tool_secret_hmac_get(tool, secret,
+			capture->target_hmac[secret][0]);
+	}
+
+	/* The other links need a partial overwrite, which takes a power
+	 * cycle.  Every overwrite covers the tail of an even secret and the
+	 * head of the odd secret after it.
+	 */
+	capture->tail = 0x55;
+	for (int secret = 0; secret < 8; secret += 2) {
+		for (int link = 1; link < links; link++) {
 			if (tool->verbose) {
-				fprintf(stderr, "\r    Secret #%d [%d/4]",
-				        secret, link);
+				fprintf(stderr, "\r    Secret #%d-%d [%d/%d]",
+				        secret, secret + 1, link, links);
 			}
 
-			xds1963s_tool_secret_hmac_target_get(tool, secret, link);
+			xds1963s_tool_secret_pair_link_write(tool, secret, link);
+
+			/* Erase the scratchpad to clear the HIDE flag. */
+			xds1963s_client_sp_erase(tool);
+			xds1963s_tool_secret_hmac_get(tool, secret,
+				capture->target_hmac[secret][link]);
+
+			xds1963s_client_sp_erase(tool);
+			xds1963s_tool_secret_hmac_get(tool, secret + 1,
+				capture->target_hmac[secret + 1][link]);
+		}
+
+		if (tool->verbose) {
+			fprintf(stderr, "\r    Secret #%d-%d [%d/%d]\n",
+			        secret, secret + 1, links, links);
 		}
+	}
 
-		if (tool->verbose)
-			fprintf(stderr, "\r    Secret #%d [4/4]\n", secret);
+	if (tool->verbose) {
+		fprintf(stderr, "    Used %d power cycles.\n",
+		        tool->client.power_cycles - power_cycles);
 	}
+}
+
+void
+ds1963s_tool_secrets_get(struct ds1963s_tool *tool,
+                         struct ds1963s_rom *rom,
+                         uint32_t counters[16])
+{
+	struct ds1963s_capture capture;
+	uint8_t data[32];
+
+	ds1963s_tool_capture(tool, rom, counters, &capture);
+
+	/* Initialize the brute forcer state. */
+	ds1963s_capture_to_brute(&capture, &tool->brute);
 
 	if (tool->verbose)
 		fprintf(stderr, "02. Calculating secrets from HMAC links.\n");
 
-	for (int secret = 0; secret < 8; secret++) {
-		for (int link = 3; link >= 0; link--)
-			ds1963s_tool_brute_link(tool, secret, link);
-	}
+	if (ds1963s_brute_run(&tool->brute) == -1)
+		fprintf(stderr, "WARNING: not all secrets could be recovered.\n");
 
 	if (tool->verbose) {
 		fprintf(stderr, "03. Restoring recovered keys.\n");
@@ -383,6 +455,11 @@ ds1963s_tool_secrets_get(struct ds1963s_tool *tool,
 	for (int i = 0; i < 4; i++)
 		memcpy(&data[i * 8], tool->brute.secrets[i + 4].secret, 8);
 	xds1963s_client_secret_write(tool, 4, data, sizeof data);
+
+	if (tool->verbose) {
+		fprintf(stderr, "    Used %d power cycles in total.\n",
+		        tool->client.power_cycles);
+	}
 }
 
 void
@@ -431,6 +508,157 @@ ds1963s_tool_info_full(struct ds1963s_tool *tool, int format)
 		ds1963s_tool_info_full_text(tool);
 }
 
+void
+ds1963s_tool_capture_file(struct ds1963s_tool *tool, const char *path)
+{
+	struct ds1963s_capture capture;
+	struct ds1963s_rom rom;
+	uint32_t counters[16];
+
+	if (ds1963s_tool_info_full_disclaimer() == 0)
+		return;
+
+	ds1963s_client_rom_get(&tool->client, &rom);
+
+	if (ds1963s_write_cycle_get_all(&tool->client, counters) == -1) {
+		ds1963s_client_perror(&tool->client,
+			"ds1963s_write_cycle_get_all()");
+		ds1963s_tool_fatal(tool);
+	}
+
+	ds1963s_tool_capture(tool, &rom, counters, &capture);
+
+	if (ds1963s_capture_write(&capture, path) == -1) {
+		perror(path);
+		ds1963s_tool_fatal(tool);
+	}
+
+	fprintf(stderr, "Captured HMAC links to %s using %d power cycles.\n",
+	        path, tool->client.power_cycles);
+	fprintf(stderr, "The secrets are now partially overwritten.  Recover "
+	                "them using --crack, and\nrestore them using "
+	                "--write-secret.\n");
+}
+
+struct ds1963s_tool_crack
+{
+	FILE			*fp;
+	const char		**paths;
+	struct ds1963s_capture	*captures;
+};
+
+/* Print the secrets recovered from a capture, along with the data needed
+ * to restore them using --write-secret.  Called as soon as all secrets of
+ * the capture are done, so results are streamed while others are still
+ * being recovered.
+ */
+static void
+__ds1963s_tool_crack_done(size_t index, struct ds1963s_brute *brute, void *arg)
+{
+	struct ds1963s_tool_crack *crack = (struct ds1963s_tool_crack *)arg;
+	struct ds1963s_capture *capture = &crack->captures[index];
+	int found, i, secret;
+
+	fprintf(crack->fp, "Capture : %s\n", crack->paths[index]);
+	fprintf(crack->fp, "Serial  : ");
+	for (i = 1; i < 7; i++)
+		fprintf(crack->fp, "%.2x", capture->rom[i]);
+	fprintf(crack->fp, "\n");
+
+	found = 0;
+	for (secret = 0; secret < 8; secret++) {
+		fprintf(crack->fp, "Secret %d: ", secret);
+		if (brute->secrets[secret].state != DS1963S_BRUTE_SECRET_FOUND) {
+			fprintf(crack->fp, "not found\n");
+			continue;
+		}
+
+		for (i = 0; i < 8; i++)
+			fprintf(crack->fp, "%.2x", brute->secrets[secret].secret[i]);
+		fprintf(crack->fp, "\n");
+		found++;
+	}
+
+	if (found == 8) {
+		for (secret = 0; secret < 8; secret += 4) {
+			fprintf(crack->fp, "Restore : --write-secret=%d ", secret);
+			for (i = 0; i < 32; i++) {
+				fprintf(crack->fp, "%.2x",
+				        brute->secrets[secret + i / 8].secret[i % 8]);
+			}
+			fprintf(crack->fp, "\n");
+		}
+	}
+
+	fprintf(crack->fp, "\n");
+	fflush(crack->fp);
+}
+
+/* Recover the secrets from all captures in 'paths' in a single run, so
+ * that all threads stay busy until the last capture is done.
+ */
+int
+ds1963s_tool_crack(const char **paths, size_t count, int jobs, int verbose,
+                   FILE *fp)
+{
+	struct ds1963s_tool_crack crack;
+	struct ds1963s_brute **brutes;
+	struct ds1963s_brute *brute;
+	size_t i, loaded;
+	int ret = 0;
+
+	crack.fp       = fp;
+	crack.paths    = calloc(count, sizeof *crack.paths);
+	crack.captures = calloc(count, sizeof *crack.captures);
+	brute          = calloc(count, sizeof *brute);
+	brutes         = calloc(count, sizeof *brutes);
+
+	if (crack.paths == NULL || crack.captures == NULL ||
+	    brute == NULL || brutes == NULL) {
+		perror("calloc()");
+		ret = -1;
+		goto out;
+	}
+
+	for (i = loaded = 0; i < count; i++) {
+		if (ds1963s_capture_read(&crack.captures[loaded], paths[i]) == -1) {
+			perror(paths[i]);
+			ret = -1;
+			continue;
+		}
+
+		crack.paths[loaded] = paths[i];
+		ds1963s_brute_init(&brute[loaded]);
+		ds1963s_capture_to_brute(&crack.captures[loaded], &brute[loaded]);
+		brutes[loaded] = &brute[loaded];
+		loaded++;
+	}
+
+	if (verbose) {
+		fprintf(stderr, "Calculating secrets from %zu capture(s).\n",
+		        loaded);
+	}
+
+	if (jobs == 0)
+		jobs = ds1963s_brute_jobs_default();
+
+	if (ds1963s_brute_run_many(brutes, loaded, jobs, verbose,
+	                           __ds1963s_tool_crack_done, &crack) == -1) {
+		fprintf(stderr, "WARNING: not all secrets could be recovered.\n");
+		ret = -1;
+	}
+
+	for (i = 0; i < loaded; i++)
+		ds1963s_brute_destroy(&brute[i]);
+
+out:
+	free(brutes);
+	free(brute);
+	free(crack.captures);
+	free(crack.paths);
+	return ret;
+}
+
 void
 ds1963s_tool_write(struct ds1963s_tool *tool, uint16_t address,
                    const uint8_t *data, size_t len)
@@ -663,9 +891,19 @@ usage(const char *progname)
 	fprintf(stderr, "Modifiers can be used for several commands.\n");
 	fprintf(stderr, "   -a --address=address  the memory address used "
 	                "in several functions.\n");
+	fprintf(stderr, "   --baud=rate           the serial speed to switch "
+	                "to if possible.\n");
 	fprintf(stderr, "   -d --device=pathname  the serial device used.\n");
+	fprintf(stderr, "   -j --jobs=n           the number of threads used "
+	                "to recover secrets.\n");
+	fprintf(stderr, "   -l --link-width=n     the secret bytes recovered "
+	                "per link: 1-4 or auto.\n");
+	fprintf(stderr, "   -o --output=file      write recovered secrets to "
+	                "'file'.\n");
 	fprintf(stderr, "   -p --page=pagenum     the page number used in "
 	                "several functions.\n");
+	fprintf(stderr, "   --reset-hold=ms       the minimum time to hold "
+	                "the power-on-reset.\n");
 	fprintf(stderr, "   -v --verbose          verbose operation.\n");
 
 	fprintf(stderr, "\nFunction that will be performed.\n");
@@ -679,18 +917,29 @@ usage(const char *progname)
 	fprintf(stderr, "   --secret-set-first=n     compute first secret and write it to secret 'n'.\n");
 	fprintf(stderr, "   --secret-set-next=n      compute next secret and write it to secret 'n'.\n");
 	fprintf(stderr, "   --write-secret=n         write data to secret 'n'.\n");
+	fprintf(stderr, "   --capture=file           capture the HMAC links of all "
+	                "secrets to 'file'.\n");
+	fprintf(stderr, "   --crack file...          recover secrets from capture "
+	                "files.\n");
 }
 
 static const struct option options[] =
 {
 	{ "address",		  1,	NULL,	'a' },
+	{ "baud",		  1,	NULL,	 0  },
+	{ "capture",		  1,	NULL,	 0  },
+	{ "crack",		  0,	NULL,	 0  },
 	{ "device",		  1,	NULL,	'd' },
 	{ "help",		  0,	NULL,	'h' },
 	{ "page",		  1,	NULL,	'p' },
 	{ "info",		  0,	NULL,	'i' },
 	{ "info-full",		  0,	NULL,	'f' },
+	{ "jobs",		  1,	NULL,	'j' },
+	{ "link-width",		  1,	NULL,	'l' },
+	{ "output",		  1,	NULL,	'o' },
 	{ "read",		  1,	NULL,	'r' },
 	{ "read-auth",		  1,	NULL,	't' },
+	{ "reset-hold",		  1,	NULL,	 0  },
 	{ "secret-set-first",     1,    NULL,    0  },
 	{ "secret-set-next",      1,    NULL,    0  },
 	{ "sign-data",		  1,	NULL,	's' },
@@ -701,25 +950,33 @@ static const struct option options[] =
 	{ NULL,			  0,	NULL,	 0  }
 };
 
-const char optstr[] = "a:d:hr:p:s:ifvwy";
+const char optstr[] = "a:d:hj:l:o:r:p:s:ifvwy";
 
 int
 main(int argc, char **argv)
 {
 	const char *device_name = DEFAULT_SERIAL_PORT;
+	const char *capture_path = NULL;
+	const char *output_path = NULL;
 	struct ds1963s_tool tool;
 	int address, page, size;
 	int mask, mode, o;
 	uint8_t data[32];
+	int reset_hold;
+	int baudrate;
 	int verbose;
+	int width;
+	int jobs;
 	size_t len;
 	int format;
 	int secret;
 	int i;
 
-	len = mode = verbose = 0;
+	len = mode = verbose = jobs = 0;
+	width = DS1963S_BRUTE_WIDTH_DEFAULT;
 	format = FORMAT_TEXT;
-	address = page = secret = size = -1;
+	address = page = secret = size = reset_hold = -1;
+	baudrate = DS1963S_CLIENT_BAUDRATE_DEFAULT;
 	while ( (o = getopt_long(argc, argv, optstr, options, &i)) != -1) {
 		switch (o) {
 		case 0:
@@ -738,6 +995,30 @@ main(int argc, char **argv)
 			} else if (!strcmp(options[i].name, "validate")) {
 				mode = MODE_VALIDATE_DATA_PAGE;
 				break;
+			} else if (!strcmp(options[i].name, "capture")) {
+				mode = MODE_CAPTURE;
+				capture_path = optarg;
+				break;
+			} else if (!strcmp(options[i].name, "crack")) {
+				mode = MODE_CRACK;
+				break;
+			} else if (!strcmp(options[i].name, "baud")) {
+				baudrate = atoi(optarg);
+				if (baudrate != 9600 && baudrate != 19200 &&
+				    baudrate != 57600 && baudrate != 115200) {
+					fprintf(stderr, "--baud expects 9600, "
+					                "19200, 57600 or 115200.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			} else if (!strcmp(options[i].name, "reset-hold")) {
+				reset_hold = atoi(optarg);
+				if (reset_hold < 0) {
+					fprintf(stderr, "--reset-hold expects "
+					                "a time in ms.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
 			}
 			break;
 		case 'a':
@@ -754,6 +1035,29 @@ main(int argc, char **argv)
 		case 'h':
 			usage(argv[0]);
 			exit(EXIT_SUCCESS);
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1) {
+				fprintf(stderr, "--jobs expects a positive number.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'l':
+			if (!strcmp(optarg, "auto")) {
+				width = 0;
+				break;
+			}
+
+			width = atoi(optarg);
+			if (width < 1 || width > DS1963S_BRUTE_WIDTH_MAX) {
+				fprintf(stderr, "--link-width expects 1-%d or "
+				                "auto.\n", DS1963S_BRUTE_WIDTH_MAX);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'o':
+			output_path = optarg;
+			break;
 		case 'r':
 			mode = MODE_READ;
 			size = atoi(optarg);
@@ -836,6 +1140,29 @@ main(int argc, char **argv)
 		len = strlen(argv[optind]) / 2;
 	}
 
+	/* Cracking captures does not need access to a DS1963S. */
+	if (mode == MODE_CRACK) {
+		FILE *fp = stdout;
+
+		if (optind >= argc) {
+			usage(argv[0]);
+			exit(EXIT_FAILURE);
+		}
+
+		if (output_path != NULL && (fp = fopen(output_path, "w")) == NULL) {
+			perror(output_path);
+			exit(EXIT_FAILURE);
+		}
+
+		o = ds1963s_tool_crack((const char **)&argv[optind],
+		                       argc - optind, jobs, verbose, fp);
+
+		if (fp != stdout)
+			fclose(fp);
+
+		exit(o == -1 ? EXIT_FAILURE : EXIT_SUCCESS);
+	}
+
 	/* Pre-check if the serial device is accessible. */
 	if (access(device_name, R_OK | W_OK) != 0) {
 		fprintf(stderr, "Cannot access %s\n", device_name);
@@ -843,11 +1170,20 @@ main(int argc, char **argv)
 	}
 
 	/* Initialize the DS1963S device. */
-	if (ds1963s_tool_init(&tool, device_name) == -1) {
+	if (ds1963s_tool_init(&tool, device_name, baudrate) == -1) {
 		ds1963s_client_perror(&tool.client, "ds1963s_init()");
 		exit(EXIT_FAILURE);
 	}
 	tool.verbose = verbose;
+	tool.brute.verbose = verbose;
+	if (reset_hold != -1)
+		tool.client.reset_hold = reset_hold;
+	if (jobs != 0)
+		tool.brute.jobs = jobs;
+	if (width != 0)
+		tool.brute.width = width;
+	else
+		tool.width_auto = 1;
 
 	switch (mode) {
 	case MODE_INFO:
@@ -880,6 +1216,9 @@ main(int argc, char **argv)
 	case MODE_VALIDATE_DATA_PAGE:
 		ds1963s_tool_validate_data_page(&tool, page);
 		break;
+	case MODE_CAPTURE:
+		ds1963s_tool_capture_file(&tool, capture_path);
+		break;
 	}
 
 	ds1963s_tool_destroy(&tool);
@@ -2,6 +2,8 @@
 #define DS1963S_TOOL_H
 
 #include <inttypes.h>
+#include "ds1963s-brute.h"
+#include "ds1963s-capture.h"
 #include "ds1963s-client.h"
 #include "ds1963s-device.h"
 
@@ -9,20 +11,6 @@
 #include <yaml.h>
 #endif
 
-struct ds1963s_brute_secret
-{
-	int		state;
-	uint8_t		target_hmac[4][20];
-	uint8_t		secret[8];
-};
-
-struct ds1963s_brute
-{
-	int				log_fd;
-	struct ds1963s_device		dev;
-	struct ds1963s_brute_secret	secrets[8];
-};
-
 struct ds1963s_tool
 {
 	/* Client for communication with a DS1963S ibutton. */
@@ -33,6 +21,9 @@ struct ds1963s_tool
 
 	int verbose;
 
+	/* Pick the link width before capturing. */
+	int width_auto;
+
 #ifdef HAVE_LIBYAML
 	yaml_emitter_t	emitter;
 #endif
@@ -42,6 +33,12 @@ struct ds1963s_tool
 extern "C" {
 #endif
 
+void
+ds1963s_tool_capture(struct ds1963s_tool *tool,
+                     struct ds1963s_rom *rom,
+                     uint32_t counters[16],
+                     struct ds1963s_capture *capture);
+
 void
 ds1963s_tool_secrets_get(struct ds1963s_tool *tool,
                          struct ds1963s_rom *rom,
@@ -130,6 +130,7 @@ void ds2480b_dev_init(struct ds2480b_device *dev)
 {
 	assert(dev != NULL);
 
+	dev->serial                  = NULL;
 	dev->accelerator             = 0;
 	dev->mode                    = DS2480_MODE_INACTIVE;
 	dev->config.slew             = DS2480_PARAM_SLEW_VALUE_15Vus;
@@ -139,12 +140,16 @@ void ds2480b_dev_init(struct ds2480b_device *dev)
 	dev->config.sampleoffset     = DS2480_PARAM_SAMPLEOFFSET_VALUE_8us;
 	dev->config.activepulluptime = DS2480_PARAM_ACTIVEPULLUPTIME_VALUE_3p0us;
 	dev->config.baudrate         = DS2480_PARAM_BAUDRATE_VALUE_9600;
+	dev->rx_pos                  = 0;
+	dev->rx_len                  = 0;
+	dev->tx_len                  = 0;
 
 	one_wire_bus_member_init(&dev->bus_master);
 	one_wire_bus_member_master_set(&dev->bus_master);
 
 	dev->bus_master.device = (void *)dev;
 	dev->bus_master.driver = (void(*)(void *))ds2480b_dev_power_on;
+	dev->bus_master.stack_size = DS2480_STACK_SIZE;
 #ifdef DEBUG
 	strncpy(dev->bus_master.name, "ds2480b", sizeof dev->bus_master.name);
 #endif
@@ -197,6 +202,109 @@ void ds2480b_dev_connect_serial(struct ds2480b_device *dev, struct transport *t)
 	dev->serial = t;
 }
 
+static int
+__ds2480b_flush(struct ds2480b_device *dev)
+{
+	if (dev->tx_len == 0)
+		return 0;
+
+	if (transport_write_all(dev->serial, dev->tx_buf, dev->tx_len) == -1)
+		return -1;
+
+	dev->tx_len = 0;
+	return 0;
+}
+
+/* Responses are collected in the transmit buffer, and only written out
+ * when it is full, or before we wait for more host input.
+ */
+static int
+__ds2480b_write(struct ds2480b_device *dev, const void *buf, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)buf;
+
+	while (size > 0) {
+		size_t n = sizeof(dev->tx_buf) - dev->tx_len;
+
+		if (n == 0) {
+			if (__ds2480b_flush(dev) == -1)
+				return -1;
+			continue;
+		}
+
+		if (n > size)
+			n = size;
+
+		memcpy(&dev->tx_buf[dev->tx_len], p, n);
+		dev->tx_len += n;
+		p           += n;
+		size        -= n;
+	}
+
+	return 0;
+}
+
+/* Everything the host has sent so far is drained from the transport in
+ * one read, and processed from the receive buffer.  Only once we have
+ * run out of it and may block, the responses to the batch are flushed.
+ */
+static int
+__ds2480b_read(struct ds2480b_device *dev, void *buf, size_t size)
+{
+	uint8_t *p = (uint8_t *)buf;
+
+	while (size > 0) {
+		size_t n = dev->rx_len - dev->rx_pos;
+
+		if (n == 0) {
+			ssize_t ret;
+
+			if (__ds2480b_flush(dev) == -1)
+				return -1;
+
+			ret = transport_read(dev->serial, dev->rx_buf,
+			                     sizeof dev->rx_buf);
+			if (ret <= 0)
+				return -1;
+
+			dev->rx_pos = 0;
+			dev->rx_len = ret;
+			continue;
+		}
+
+		if (n > size)
+			n = size;
+
+		memcpy(p, &dev->rx_buf[dev->rx_pos], n);
+		dev->rx_pos += n;
+		p           += n;
+		size        -= n;
+	}
+
+	return 0;
+}
+
+static const int __baudrates[4] = { 9600, 19200, 57600, 115200 };
+
+/* A break brings the baud rate back to 9600 bps, but we cannot see one on
+ * an emulated port.  The host switches its own side of the line back to
+ * 9600 bps before it sends the break though, so a line speed that no
+ * longer matches ours counts as one.
+ */
+static int
+__ds2480b_break_seen(struct ds2480b_device *dev)
+{
+	int baudrate;
+
+	if (dev->serial == NULL)
+		return 0;
+
+	if ( (baudrate = transport_baudrate_get(dev->serial)) == -1)
+		return 0;
+
+	return baudrate != __baudrates[dev->config.baudrate];
+}
+
 void ds2480b_dev_reset(struct ds2480b_device *dev, int speed)
 {
 	assert(dev != NULL);
@@ -213,7 +321,14 @@ void ds2480b_dev_reset(struct ds2480b_device *dev, int speed)
 	dev->config.write1low        = DS2480_PARAM_WRITE1LOW_VALUE_8us;
 	dev->config.sampleoffset     = DS2480_PARAM_SAMPLEOFFSET_VALUE_8us;
 	dev->config.activepulluptime = DS2480_PARAM_ACTIVEPULLUPTIME_VALUE_3p0us;
-	dev->config.baudrate         = DS2480_PARAM_BAUDRATE_VALUE_9600;
+
+	/* The baud rate is kept, as the host goes on talking to us at that
+	 * rate after a reset, unless there was a break.
+	 */
+	if (__ds2480b_break_seen(dev)) {
+		DEBUG_LOG("    break: baudrate 9600\n");
+		dev->config.baudrate = DS2480_PARAM_BAUDRATE_VALUE_9600;
+	}
 }
 
 static inline int
@@ -235,6 +350,33 @@ __ds2480b_speed_parse(int speed)
 	abort();
 }
 
+/* Switch the serial port over to the configured baud rate.  Whatever we
+ * still have buffered was sent before the switch, so it goes out first.
+ * The reply to the configuration command itself follows at the new rate.
+ * Transports without a line speed simply keep going.
+ */
+static int
+__ds2480b_baudrate_apply(struct ds2480b_device *dev)
+{
+	assert(dev->config.baudrate >= 0 && dev->config.baudrate <= 3);
+
+	if (dev->serial == NULL)
+		return 0;
+
+	if (__ds2480b_flush(dev) == -1)
+		return -1;
+
+	DEBUG_LOG("    baudrate: %d\n", __baudrates[dev->config.baudrate]);
+
+	dev->serial->error = TRANSPORT_ERROR_NONE;
+	if (transport_baudrate_set(dev->serial,
+	                           __baudrates[dev->config.baudrate]) == -1 &&
+	    dev->serial->error != TRANSPORT_ERROR_UNSUPPORTED)
+		return -1;
+
+	return 0;
+}
+
 int ds2480b_dev_config_read(struct ds2480b_device *dev, int param)
 {
 	assert(dev != NULL);
@@ -304,8 +446,11 @@ int ds2480b_dev_config_write(struct ds2480b_device *dev, int param, int value)
 		if (value < 0 || value > 3)
 			return -1;
 
+		if (dev->config.baudrate == value)
+			break;
+
 		dev->config.baudrate = value;
-		break;
+		return __ds2480b_baudrate_apply(dev);
 	default:
 		return -1;
 	}
@@ -340,6 +485,9 @@ ds2480b_dev_command_configuration(struct ds2480b_device *dev, unsigned char byte
 	if (param_code == DS2480_PARAM_PARMREAD) {
 		param_code  = param_value;
 		param_value = ds2480b_dev_config_read(dev, param_code);
+		if (param_value == -1)
+			return -1;
+
 		reply = param_value << 1;
 		DEBUG_LOG("  PARMREAD: %s (0x%.2x)\n",
 			__param_value_names[param_code][param_value],
@@ -356,7 +504,9 @@ ds2480b_dev_command_configuration(struct ds2480b_device *dev, unsigned char byte
 static int
 ds2480b_dev_command_reset(struct ds2480b_device *dev, unsigned char byte)
 {
-	assert( (byte & 0xE3) == 0xC1);
+	/* Bit 1 of a reset command has to be clear. */
+	if ( (byte & 0xE3) != 0xC1)
+		return -1;
 
 	dev->speed = __ds2480b_speed_parse( (byte >> 2) & 3);
 	DEBUG_LOG("    speed: %s (%d)\n", __speed_names[dev->speed], dev->speed);
@@ -390,7 +540,10 @@ static int
 ds2480b_dev_command_search_accel(struct ds2480b_device *dev, unsigned char byte)
 {
 	assert(dev != NULL);
-	assert( (byte & 2) == 0);
+
+	/* Bit 1 of a search accelerator command has to be clear. */
+	if ( (byte & 2) != 0)
+		return -1;
 
 	dev->accelerator = (byte >> 4) & 1;
 	dev->speed       = __ds2480b_speed_parse( (byte >> 2) & 3);
@@ -460,7 +613,10 @@ ds2480b_dev_command_mode(struct ds2480b_device *dev, unsigned char byte)
 	case DS2480_COMMAND_RESET:
 		return ds2480b_dev_command_reset(dev, byte);
 	case DS2480_COMMAND_PULSE:
-		assert( ((byte >> 2) & 3) == 3);
+		/* Pulses are always sent at the speed code for 12V. */
+		if ( ((byte >> 2) & 3) != 3)
+			return -1;
+
 		int arm_pullup = (byte >> 1) & 1;
 		int pulse_type = (byte >> 4) & 1;
 		DEBUG_LOG("    arm_pullup: %d pulse_type: %d\n", arm_pullup, pulse_type);
@@ -470,61 +626,73 @@ ds2480b_dev_command_mode(struct ds2480b_device *dev, unsigned char byte)
 	return -1;
 }
 
+/* Perform a search pass with the search accelerator.  The host sends
+ * 16 bytes holding a direction bit r_n at bit 2n + 1 for every ROM bit n,
+ * with bit 2n ignored.  For each ROM bit we read the bit and its
+ * complement from the bus, and write back the ROM bit if they differ.
+ * On a discrepancy, where both are 0, we follow r_n instead.  When both
+ * are 1 no device is taking part anymore and we write a 1.  The response
+ * holds the discrepancy flag d_n at bit 2n and the chosen bit at 2n + 1.
+ */
 static int
-ds2480b_dev_data_mode(struct ds2480b_device *dev, uint8_t byte, int checked)
+ds2480b_dev_search_accel(struct ds2480b_device *dev, uint8_t byte)
 {
-	assert(dev != NULL);
+	uint8_t response[16] = { 0 };
+	uint8_t search[16];
 
-	if (checked == 0 && byte == 0xE3) {
-		DEBUG_LOG("[DS2480] MODE_DATA -> MODE_CHECK\n");
-		dev->mode = DS2480_MODE_CHECK;
-		return -2;
-	}
+	search[0] = byte;
+	if (__ds2480b_read(dev, &search[1], sizeof(search) - 1) == -1)
+		return -1;
 
-	/* Special case; we perform the search here. */
-	if (dev->accelerator) {
-		uint8_t search[16];
-		uint8_t response[16] = {0};
+	for (int i = 0; i < 64; i++) {
+		int b1, b2, d = 0;
 
-		/* We receive 16 bytes from serial for the search. */
-		search[0] = byte;
-		if (transport_read_all(dev->serial, &search[1], 15) == -1)
+		if ( (b1 = ds2480b_dev_bus_rx_bit(dev)) < 0)
 			return -1;
 
-		for (int i = 0; i < 64; i++) {
-			int b1 = ds2480b_dev_bus_rx_bit(dev);
-			[[maybe_unused]] int b2 = ds2480b_dev_bus_rx_bit(dev);
-
-#if 0
-			/* Conflict */
-			if (b1 == b2) {
-				DEBUG_LOG("conflict: %d\n", b1);
-				b1 = (search[i * 2 / 8] >> (i % 8 + 1)) & 1;
-				response[i * 2 / 8] |= 1 << (i % 8);
-			}
-#endif
+		if ( (b2 = ds2480b_dev_bus_rx_bit(dev)) < 0)
+			return -1;
 
-			printf("b1: %d\n", b1);
-			response[i * 2 / 8] |= b1 << ((i * 2 % 8) + 1);
-			ds2480b_dev_bus_tx_bit(dev, b1);
-			printf("TXed rom bit #%d\n", i);
+		if (b1 == b2) {
+			d  = 1;
+			b1 = b1 ? 1 : (search[i / 4] >> (i % 4 * 2 + 1)) & 1;
 		}
 
-		DEBUG_LOG("RESPONSE: ");
-		for (int i = 0; i < 16; i++)
-			DEBUG_LOG("%.2x", ((uint8_t *)response)[i]);
-		DEBUG_LOG("\n");
+		response[i / 4] |= d << (i % 4 * 2);
+		response[i / 4] |= b1 << (i % 4 * 2 + 1);
 
-		DEBUG_LOG("writing response ...\n");
-//		if (transport_write_all(dev->serial, &byte, 1) == -1)
-//			return -1;
-
-		if (transport_write_all(dev->serial, response, 16) == -1)
+		if (ds2480b_dev_bus_tx_bit(dev, b1) < 0)
 			return -1;
+	}
+
+	DEBUG_LOG("    search response: ");
+	for (int i = 0; i < sizeof(response); i++)
+		DEBUG_LOG("%.2x", response[i]);
+	DEBUG_LOG("\n");
+
+	if (__ds2480b_write(dev, response, sizeof(response)) == -1)
+		return -1;
+
+	return -2;
+}
+
+static int
+ds2480b_dev_data_mode(struct ds2480b_device *dev, uint8_t byte, int checked)
+{
+	assert(dev != NULL);
 
+	if (checked == 0 && byte == 0xE3) {
+		DEBUG_LOG("[DS2480] MODE_DATA -> MODE_CHECK\n");
+		dev->mode = DS2480_MODE_CHECK;
 		return -2;
 	}
 
+	/* With the search accelerator on, data is consumed in 16 byte
+	 * blocks, each of which drives a full 64 bit search pass.
+	 */
+	if (dev->accelerator)
+		return ds2480b_dev_search_accel(dev, byte);
+
 	return ds2480b_dev_bus_tx_byte(dev, byte);
 }
 
@@ -562,7 +730,7 @@ int ds2480b_dev_power_on(struct ds2480b_device *dev)
 	DEBUG_LOG("[ds2480b] power on\n");
 
 	/* Handle the calibration byte. */
-	if (transport_read_all(dev->serial, &request, 1) == -1)
+	if (__ds2480b_read(dev, &request, 1) == -1)
 		return -1;
 
 	DEBUG_LOG("    reset pulse: %.2x\n", request);
@@ -575,7 +743,7 @@ int ds2480b_dev_power_on(struct ds2480b_device *dev)
 	dev->mode = DS2480_MODE_COMMAND;
 
 	while (dev->mode != DS2480_MODE_INACTIVE) {
-		if (transport_read_all(dev->serial, &request, 1) == -1)
+		if (__ds2480b_read(dev, &request, 1) == -1)
 			return -1;
 
 		DEBUG_LOG("[ds2480b] mode: %d command: %.2x\n", dev->mode, request);
@@ -595,8 +763,11 @@ int ds2480b_dev_power_on(struct ds2480b_device *dev)
 			break;
 		}
 
-		if (response == -1)
+		/* Answer what came before, then give up. */
+		if (response == -1) {
+			__ds2480b_flush(dev);
 			return -1;
+		}
 
 		/* We have a real response, and we're still active, so we'll
 		 * reply on the bus.
@@ -604,7 +775,7 @@ int ds2480b_dev_power_on(struct ds2480b_device *dev)
 		if (response >= 0 && dev->mode != DS2480_MODE_INACTIVE) {
 			unsigned char res = (unsigned char)response;
 
-			if (transport_write_all(dev->serial, &res, 1) == -1)
+			if (__ds2480b_write(dev, &res, 1) == -1)
 				return -1;
 		}
 	}
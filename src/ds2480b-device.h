@@ -110,6 +110,12 @@
 #define DS2480_PARAM_BAUDRATE_VALUE_57600		2
 #define DS2480_PARAM_BAUDRATE_VALUE_115200		3
 
+/* The device coroutine peaks at around 10 KiB of stack. */
+#define DS2480_STACK_SIZE				32768
+
+/* Size of the serial receive and transmit buffers. */
+#define DS2480_BUFFER_SIZE				256
+
 struct ds2480b_device_configuration
 {
 	int	slew;
@@ -132,6 +138,13 @@ struct ds2480b_device
 	struct one_wire_bus_member bus_master;
 	/* Host serial port the ds2480b communicated with. */
 	struct transport *serial;
+
+	/* Host bytes still to process, and responses not yet sent. */
+	uint8_t	rx_buf[DS2480_BUFFER_SIZE];
+	size_t	rx_pos;
+	size_t	rx_len;
+	uint8_t	tx_buf[DS2480_BUFFER_SIZE];
+	size_t	tx_len;
 };
 
 #ifdef __cplusplus
@@ -76,6 +76,26 @@ static inline void list_del_init(struct list_head *lh)
 	list_init(lh);
 }
 
+static inline void list_move_tail(struct list_head *lh, struct list_head *head)
+{
+	lh->prev->next = lh->next;
+	lh->next->prev = lh->prev;
+	list_add_tail(lh, head);
+}
+
+static inline void list_splice_tail_init(struct list_head *list,
+                                         struct list_head *head)
+{
+	if (list->next == list)
+		return;
+
+	list->next->prev = head->prev;
+	head->prev->next = list->next;
+	list->prev->next = head;
+	head->prev = list->prev;
+	list_init(list);
+}
+
 static inline int list_empty(struct list_head *head)
 {
 	return head->next == head;
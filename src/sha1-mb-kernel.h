@@ -0,0 +1,265 @@
+/* sha1-mb-kernel.h
+ *
+ * Multi-buffer SHA-1 compression kernel template.
+ *
+ * This file is included by the sha1-mb-*.c files after they define
+ * SHA1_MB_LANES and SHA1_MB_NAME, and is compiled once for every
+ * instruction set we support.  The kernel is written using GCC vector
+ * extensions, so the compiler maps it onto whatever the translation unit
+ * is allowed to use: SSE2, AVX2, AVX-512 or plain scalar code.
+ *
+ * Input and output are lane interleaved: word 'i' of lane 'l' is found at
+ * index i * SHA1_MB_LANES + l.  Every instance provides a generic compress
+ * function, and a search function for blocks that differ in a single word.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+#include "sha1-mb.h"
+
+#if !defined(SHA1_MB_LANES) || !defined(SHA1_MB_NAME)
+#error "SHA1_MB_LANES and SHA1_MB_NAME need to be defined."
+#endif
+
+#define __SHA1_MB_FN(name, fn)	sha1_mb_ ## fn ## _ ## name
+#define _SHA1_MB_FN(name, fn)	__SHA1_MB_FN(name, fn)
+#define SHA1_MB_FN(fn)		_SHA1_MB_FN(SHA1_MB_NAME, fn)
+
+typedef uint32_t vec_t __attribute__((vector_size(SHA1_MB_LANES * 4)));
+
+#define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+/* blk0() and blk() perform the initial expand, as in sha1.c. */
+#define blk0(i) (w[i])
+#define blk(i) (w[i&15] = rol(w[(i+13)&15]^w[(i+8)&15]^w[(i+2)&15]^w[i&15],1))
+
+/* (R0+R1), R2, R3, R4 are the different operations used in SHA1 */
+#define R0(v,w,x,y,z,i) z+=((w&(x^y))^y)+blk0(i)+0x5A827999+rol(v,5);w=rol(w,30);
+#define R1(v,w,x,y,z,i) z+=((w&(x^y))^y)+blk(i)+0x5A827999+rol(v,5);w=rol(w,30);
+#define R2(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0x6ED9EBA1+rol(v,5);w=rol(w,30);
+#define R3(v,w,x,y,z,i) z+=(((w|x)&y)|(w&x))+blk(i)+0x8F1BBCDC+rol(v,5);w=rol(w,30);
+#define R4(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0xCA62C1D6+rol(v,5);w=rol(w,30);
+
+/* 4 rounds of 20 operations each. Loop unrolled. */
+#define SHA1_MB_ROUNDS(R0, R1, R2, R3, R4)				\
+	R0(a,b,c,d,e, 0); R0(e,a,b,c,d, 1); R0(d,e,a,b,c, 2); R0(c,d,e,a,b, 3); \
+	R0(b,c,d,e,a, 4); R0(a,b,c,d,e, 5); R0(e,a,b,c,d, 6); R0(d,e,a,b,c, 7); \
+	R0(c,d,e,a,b, 8); R0(b,c,d,e,a, 9); R0(a,b,c,d,e,10); R0(e,a,b,c,d,11); \
+	R0(d,e,a,b,c,12); R0(c,d,e,a,b,13); R0(b,c,d,e,a,14); R0(a,b,c,d,e,15); \
+	R1(e,a,b,c,d,16); R1(d,e,a,b,c,17); R1(c,d,e,a,b,18); R1(b,c,d,e,a,19); \
+	R2(a,b,c,d,e,20); R2(e,a,b,c,d,21); R2(d,e,a,b,c,22); R2(c,d,e,a,b,23); \
+	R2(b,c,d,e,a,24); R2(a,b,c,d,e,25); R2(e,a,b,c,d,26); R2(d,e,a,b,c,27); \
+	R2(c,d,e,a,b,28); R2(b,c,d,e,a,29); R2(a,b,c,d,e,30); R2(e,a,b,c,d,31); \
+	R2(d,e,a,b,c,32); R2(c,d,e,a,b,33); R2(b,c,d,e,a,34); R2(a,b,c,d,e,35); \
+	R2(e,a,b,c,d,36); R2(d,e,a,b,c,37); R2(c,d,e,a,b,38); R2(b,c,d,e,a,39); \
+	R3(a,b,c,d,e,40); R3(e,a,b,c,d,41); R3(d,e,a,b,c,42); R3(c,d,e,a,b,43); \
+	R3(b,c,d,e,a,44); R3(a,b,c,d,e,45); R3(e,a,b,c,d,46); R3(d,e,a,b,c,47); \
+	R3(c,d,e,a,b,48); R3(b,c,d,e,a,49); R3(a,b,c,d,e,50); R3(e,a,b,c,d,51); \
+	R3(d,e,a,b,c,52); R3(c,d,e,a,b,53); R3(b,c,d,e,a,54); R3(a,b,c,d,e,55); \
+	R3(e,a,b,c,d,56); R3(d,e,a,b,c,57); R3(c,d,e,a,b,58); R3(b,c,d,e,a,59); \
+	R4(a,b,c,d,e,60); R4(e,a,b,c,d,61); R4(d,e,a,b,c,62); R4(c,d,e,a,b,63); \
+	R4(b,c,d,e,a,64); R4(a,b,c,d,e,65); R4(e,a,b,c,d,66); R4(d,e,a,b,c,67); \
+	R4(c,d,e,a,b,68); R4(b,c,d,e,a,69); R4(a,b,c,d,e,70); R4(e,a,b,c,d,71); \
+	R4(d,e,a,b,c,72); R4(c,d,e,a,b,73); R4(b,c,d,e,a,74); R4(a,b,c,d,e,75); \
+	R4(e,a,b,c,d,76); R4(d,e,a,b,c,77); R4(c,d,e,a,b,78); R4(b,c,d,e,a,79);
+
+static inline void
+SHA1_MB_FN(output)(uint32_t *out, vec_t a, vec_t b, vec_t c, vec_t d, vec_t e)
+{
+	memcpy(&out[0 * SHA1_MB_LANES], &a, sizeof(vec_t));
+	memcpy(&out[1 * SHA1_MB_LANES], &b, sizeof(vec_t));
+	memcpy(&out[2 * SHA1_MB_LANES], &c, sizeof(vec_t));
+	memcpy(&out[3 * SHA1_MB_LANES], &d, sizeof(vec_t));
+	memcpy(&out[4 * SHA1_MB_LANES], &e, sizeof(vec_t));
+}
+
+/* Compress SHA1_MB_LANES independent blocks, and return the working state
+ * A, B, C, D, E after 80 rounds.  Unlike a regular SHA-1 transform the
+ * initial state is not added back, as the DS1963S uses the raw state.
+ */
+void
+SHA1_MB_FN(compress)(const uint32_t *in, uint32_t *out)
+{
+	vec_t a, b, c, d, e, w[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		memcpy(&w[i], &in[i * SHA1_MB_LANES], sizeof(vec_t));
+
+	a = (vec_t){} + 0x67452301;
+	b = (vec_t){} + 0xEFCDAB89;
+	c = (vec_t){} + 0x98BADCFE;
+	d = (vec_t){} + 0x10325476;
+	e = (vec_t){} + 0xC3D2E1F0;
+
+	SHA1_MB_ROUNDS(R0, R1, R2, R3, R4)
+
+	SHA1_MB_FN(output)(out, a, b, c, d, e);
+}
+
+/* Returns whether schedule word W[t] depends on message word 'word'.  Over
+ * GF(2) every W[t] is a XOR of rotated message words, in which the same
+ * rotation of a word can show up an even number of times and cancel.  So
+ * W[27] does not depend on word 0 even though W[24] and W[19] do.  For
+ * words 0 and 12 this is known at compile time; bit t of the masks below
+ * is set if W[t] depends on it, with rounds 64 to 79 in a second mask.
+ */
+static inline __attribute__((always_inline)) int
+__sha1_mb_dep(int word, int t)
+{
+	if (t < 16)
+		return t == word;
+
+	if (word == 0)
+		return t < 64 ? (0xFFDFDD7DD3490001ULL >> t) & 1
+		              : (0xDFDD >> (t - 64)) & 1;
+
+	if (word == 12)
+		return t < 64 ? (0xFFFFFFFDB4901000ULL >> t) & 1
+		              : (0xFFFF >> (t - 64)) & 1;
+
+	return 1;
+}
+
+/* Search rounds.  Rounds before the varying word are skipped, as
+ * search->state holds the midstate after them.  Schedule words that do
+ * not depend on the varying word are taken from search->W, and already
+ * have the round constant added in search->WK.  Only the others are
+ * expanded in w[].
+ */
+#define SW(i)		(*(const vec_t *)search->W[i])
+#define SWK(i)		(*(const vec_t *)search->WK[i])
+#define SWSET(i)	(w[(i)&15] = SW(i))
+#define SR(f,k,v,w,x,y,z,i,wv)						\
+	if ((i) >= word && (i) < last) {				\
+		if (__sha1_mb_dep(word, i)) {				\
+			z += f(w,x,y) + (wv) + k + rol(v,5);		\
+		} else {						\
+			z += f(w,x,y) + SWK(i) + rol(v,5);		\
+			SWSET(i);					\
+		}							\
+		w = rol(w,30);						\
+	}
+#define F1(w,x,y)	((w&(x^y))^y)
+#define F2(w,x,y)	(w^x^y)
+#define F3(w,x,y)	(((w|x)&y)|(w&x))
+#define S0(v,w,x,y,z,i) SR(F1,0x5A827999,v,w,x,y,z,i,blk0(i))
+#define S1(v,w,x,y,z,i) SR(F1,0x5A827999,v,w,x,y,z,i,blk(i))
+#define S2(v,w,x,y,z,i) SR(F2,0x6ED9EBA1,v,w,x,y,z,i,blk(i))
+#define S3(v,w,x,y,z,i) SR(F3,0x8F1BBCDC,v,w,x,y,z,i,blk(i))
+#define S4(v,w,x,y,z,i) SR(F2,0xCA62C1D6,v,w,x,y,z,i,blk(i))
+
+/* Run rounds [word, last) and store the variables a, b, c, d, e of the
+ * unrolled rounds in 'v'.  Always inlined, so that for a constant 'word'
+ * and 'last' the compiler drops the skipped rounds and the expansion of
+ * every independent schedule word.
+ */
+static inline __attribute__((always_inline)) void
+SHA1_MB_FN(search_rounds)(const struct sha1_mb_search *search,
+                          const uint32_t *values, vec_t v[5],
+                          const int word, const int last)
+{
+	vec_t a, b, c, d, e, x, w[16];
+	vec_t *vars[5] = { &a, &b, &c, &d, &e };
+	int i;
+
+	memcpy(&x, values, sizeof x);
+	for (i = 0; i < 16; i++)
+		w[i] = i == word ? x : SW(i);
+
+	/* Before round r, A is held in the variable the unrolled rounds use
+	 * as 'v' in round r, which rotates with a period of 5.
+	 */
+	for (i = 0; i < 5; i++)
+		*vars[(5 - word % 5 + i) % 5] = (vec_t){} + search->state[i];
+
+	SHA1_MB_ROUNDS(S0, S1, S2, S3, S4)
+
+	v[0] = a;
+	v[1] = b;
+	v[2] = c;
+	v[3] = d;
+	v[4] = e;
+}
+
+static inline __attribute__((always_inline)) void
+SHA1_MB_FN(search_word)(const struct sha1_mb_search *search,
+                        const uint32_t *values, uint32_t *out, const int word)
+{
+	vec_t v[5];
+
+	SHA1_MB_FN(search_rounds)(search, values, v, word, 80);
+	SHA1_MB_FN(output)(out, v[0], v[1], v[2], v[3], v[4]);
+}
+
+/* The last 4 rounds only shift A along, so E of the result is A after
+ * round 75 rotated by 30.  Round 75 computes A into 'e'.
+ */
+static inline __attribute__((always_inline)) uint32_t
+SHA1_MB_FN(find_word)(const struct sha1_mb_search *search,
+                      const uint32_t *values, const int word)
+{
+	uint32_t mask = 0;
+	vec_t v[5];
+	int i;
+
+	SHA1_MB_FN(search_rounds)(search, values, v, word, 76);
+	v[4] = v[4] == (vec_t){} + search->reject;
+
+	for (i = 0; i < SHA1_MB_LANES; i++)
+		mask |= (v[4][i] & 1) << i;
+
+	return mask;
+}
+
+/* Compress SHA1_MB_LANES blocks that only differ in word search->word,
+ * which takes the values in 'values'.  The DS1963S secrets we recover
+ * end up in word 0 or word 12, so these get a specialized version.
+ */
+void
+SHA1_MB_FN(search)(const struct sha1_mb_search *search,
+                   const uint32_t *values, uint32_t *out)
+{
+	switch (search->word) {
+	case 0:
+		SHA1_MB_FN(search_word)(search, values, out, 0);
+		break;
+	case 12:
+		SHA1_MB_FN(search_word)(search, values, out, 12);
+		break;
+	default:
+		SHA1_MB_FN(search_word)(search, values, out, search->word);
+		break;
+	}
+}
+
+/* Like search, but stop after round 75 and return a mask of the lanes
+ * that may match the target set with sha1_mb_search_target().
+ */
+uint32_t
+SHA1_MB_FN(find)(const struct sha1_mb_search *search, const uint32_t *values)
+{
+	switch (search->word) {
+	case 0:
+		return SHA1_MB_FN(find_word)(search, values, 0);
+	case 12:
+		return SHA1_MB_FN(find_word)(search, values, 12);
+	default:
+		return SHA1_MB_FN(find_word)(search, values, search->word);
+	}
+}
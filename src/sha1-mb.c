@@ -0,0 +1,381 @@
+/* sha1-mb.c
+ *
+ * Multi-buffer SHA-1 compression for DS1963S secret recovery.
+ *
+ * The DS1963S computes its MACs as a single SHA-1 compression of a 64 byte
+ * block, and exposes the raw working state instead of a regular digest.
+ * When recovering secrets we hash the same block over and over with only
+ * a single word changed, so we compress several blocks at once in the
+ * lanes of a vector register.  The kernel used is selected at runtime
+ * based on what the CPU supports.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <pthread.h>
+#include <string.h>
+#include "sha1.h"
+#include "sha1-mb.h"
+
+static int
+__sha1_mb_supported_always(void)
+{
+	return 1;
+}
+
+#ifdef HAVE_SHA1_MB_X86
+static int
+__sha1_mb_supported_sse2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+static int
+__sha1_mb_supported_avx2(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+
+static int
+__sha1_mb_supported_avx512(void)
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+/* Kernels in order of preference. */
+static const struct sha1_mb_kernel sha1_mb_kernels[] = {
+#ifdef HAVE_SHA1_MB_X86
+	{
+		"avx512", 16, __sha1_mb_supported_avx512,
+		sha1_mb_compress_avx512, sha1_mb_search_avx512,
+		sha1_mb_find_avx512
+	},
+	{
+		"avx2", 8, __sha1_mb_supported_avx2,
+		sha1_mb_compress_avx2, sha1_mb_search_avx2,
+		sha1_mb_find_avx2
+	},
+	{
+		"sse2", 4, __sha1_mb_supported_sse2,
+		sha1_mb_compress_sse2, sha1_mb_search_sse2,
+		sha1_mb_find_sse2
+	},
+#endif
+	{
+		"scalar", 1, __sha1_mb_supported_always,
+		sha1_mb_compress_scalar, sha1_mb_search_scalar,
+		sha1_mb_find_scalar
+	}
+};
+
+#define SHA1_MB_KERNEL_COUNT \
+	(sizeof(sha1_mb_kernels) / sizeof(sha1_mb_kernels[0]))
+
+static const struct sha1_mb_kernel *sha1_mb_kernel;
+static pthread_once_t sha1_mb_kernel_once = PTHREAD_ONCE_INIT;
+
+static void
+__sha1_mb_kernel_select(void)
+{
+	size_t i;
+
+	for (i = 0; i < SHA1_MB_KERNEL_COUNT; i++) {
+		if (sha1_mb_kernels[i].supported()) {
+			sha1_mb_kernel = &sha1_mb_kernels[i];
+			return;
+		}
+	}
+}
+
+const struct sha1_mb_kernel *
+sha1_mb_kernel_get(void)
+{
+	pthread_once(&sha1_mb_kernel_once, __sha1_mb_kernel_select);
+	return sha1_mb_kernel;
+}
+
+/* Force the use of the kernel called 'name'.  This is meant for testing
+ * and benchmarking, and should not be called while hashing is in progress.
+ * Returns 0 on success, and -1 if the kernel is unknown or unsupported.
+ */
+int
+sha1_mb_kernel_set(const char *name)
+{
+	size_t i;
+
+	assert(name != NULL);
+
+	pthread_once(&sha1_mb_kernel_once, __sha1_mb_kernel_select);
+
+	for (i = 0; i < SHA1_MB_KERNEL_COUNT; i++) {
+		if (strcmp(sha1_mb_kernels[i].name, name) != 0)
+			continue;
+
+		if (!sha1_mb_kernels[i].supported())
+			return -1;
+
+		sha1_mb_kernel = &sha1_mb_kernels[i];
+		return 0;
+	}
+
+	return -1;
+}
+
+static void
+__sha1_mb_output(const struct sha1_mb_kernel *kernel, const uint32_t *buf,
+                 uint32_t (*out)[5], size_t count)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < count; i++)
+		for (j = 0; j < 5; j++)
+			out[i][j] = buf[j * kernel->lanes + i];
+}
+
+/* Compress 'count' independent blocks of 16 big-endian words, and store
+ * the raw working state A, B, C, D, E after 80 rounds in 'out'.
+ */
+void
+sha1_mb_compress_raw(const uint32_t (*in)[16], uint32_t (*out)[5],
+                     size_t count)
+{
+	const struct sha1_mb_kernel *kernel = sha1_mb_kernel_get();
+	uint32_t buf_in[16 * SHA1_MB_LANES_MAX] = { 0 };
+	uint32_t buf_out[5 * SHA1_MB_LANES_MAX];
+	size_t i, j, n;
+	int w;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < (size_t)kernel->lanes ? count - i : kernel->lanes;
+
+		for (j = 0; j < n; j++)
+			for (w = 0; w < 16; w++)
+				buf_in[w * kernel->lanes + j] = in[i + j][w];
+
+		kernel->compress(buf_in, buf_out);
+		__sha1_mb_output(kernel, buf_out, &out[i], n);
+	}
+}
+
+/* Compress 'count' blocks that are equal to 'base', except for word
+ * 'word' which takes the values in 'values'.  This is the common case
+ * when recovering secrets, and saves us from transposing the full blocks.
+ */
+void
+sha1_mb_compress_raw_word(const uint32_t base[16], int word,
+                          const uint32_t *values, uint32_t (*out)[5],
+                          size_t count)
+{
+	const struct sha1_mb_kernel *kernel = sha1_mb_kernel_get();
+	uint32_t buf_in[16 * SHA1_MB_LANES_MAX];
+	uint32_t buf_out[5 * SHA1_MB_LANES_MAX];
+	uint32_t *row;
+	size_t i, j, n;
+	int w, l;
+
+	assert(word >= 0 && word < 16);
+
+	for (w = 0; w < 16; w++)
+		for (l = 0; l < kernel->lanes; l++)
+			buf_in[w * kernel->lanes + l] = base[w];
+
+	row = &buf_in[word * kernel->lanes];
+	for (i = 0; i < count; i += n) {
+		n = count - i < (size_t)kernel->lanes ? count - i : kernel->lanes;
+
+		for (j = 0; j < n; j++)
+			row[j] = values[i + j];
+
+		kernel->compress(buf_in, buf_out);
+		__sha1_mb_output(kernel, buf_out, &out[i], n);
+	}
+}
+
+#define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+static const uint32_t __sha1_mb_k[4] = {
+	0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xCA62C1D6
+};
+
+/* Run SHA-1 rounds [first, last) over 'state' using the schedule 'W'. */
+static void
+__sha1_mb_rounds(uint32_t state[5], const uint32_t W[80], int first, int last)
+{
+	uint32_t a = state[0], b = state[1], c = state[2];
+	uint32_t d = state[3], e = state[4];
+	uint32_t f, t;
+	int i;
+
+	for (i = first; i < last; i++) {
+		if (i < 20)
+			f = (b & (c ^ d)) ^ d;
+		else if (i < 40 || i >= 60)
+			f = b ^ c ^ d;
+		else
+			f = ((b | c) & d) | (b & c);
+
+		t = rol(a, 5) + f + e + __sha1_mb_k[i / 20] + W[i];
+		e = d;
+		d = c;
+		c = rol(b, 30);
+		b = a;
+		a = t;
+	}
+
+	state[0] = a;
+	state[1] = b;
+	state[2] = c;
+	state[3] = d;
+	state[4] = e;
+}
+
+/* Prepare 'search' for hashing variations of 'block' in word 'word'.  The
+ * value of block[word] itself is ignored.  We expand the schedule of the
+ * block with that word set to zero, and run the rounds before it.  The
+ * kernels only use the schedule words that do not depend on it.
+ */
+void
+sha1_mb_search_init(struct sha1_mb_search *search, const uint32_t block[16],
+                    int word)
+{
+	uint32_t W[80];
+	int i, j;
+
+	assert(search != NULL);
+	assert(word >= 0 && word < 16);
+
+	memcpy(W, block, 16 * sizeof *W);
+	W[word] = 0;
+
+	for (i = 16; i < 80; i++)
+		W[i] = rol(W[i - 3] ^ W[i - 8] ^ W[i - 14] ^ W[i - 16], 1);
+
+	/* Store the schedule broadcast over all lanes, so that the kernels
+	 * can use it without shuffling.
+	 */
+	for (i = 0; i < 80; i++) {
+		for (j = 0; j < SHA1_MB_LANES_MAX; j++) {
+			search->W[i][j]  = W[i];
+			search->WK[i][j] = W[i] + __sha1_mb_k[i / 20];
+		}
+	}
+
+	search->word     = word;
+	search->state[0] = 0x67452301;
+	search->state[1] = 0xEFCDAB89;
+	search->state[2] = 0x98BADCFE;
+	search->state[3] = 0x10325476;
+	search->state[4] = 0xC3D2E1F0;
+	__sha1_mb_rounds(search->state, W, 0, word);
+}
+
+/* Compress 'count' variations of the block 'search' was prepared for,
+ * with the varying word taking the values in 'values', and store the raw
+ * working state A, B, C, D, E after 80 rounds in 'out'.
+ */
+void
+sha1_mb_search(const struct sha1_mb_search *search, const uint32_t *values,
+               uint32_t (*out)[5], size_t count)
+{
+	const struct sha1_mb_kernel *kernel = sha1_mb_kernel_get();
+	uint32_t buf_in[SHA1_MB_LANES_MAX];
+	uint32_t buf_out[5 * SHA1_MB_LANES_MAX];
+	size_t i, n;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < (size_t)kernel->lanes ? count - i : kernel->lanes;
+
+		if (n == (size_t)kernel->lanes) {
+			kernel->search(search, &values[i], buf_out);
+		} else {
+			memset(buf_in, 0, sizeof buf_in);
+			memcpy(buf_in, &values[i], n * sizeof *buf_in);
+			kernel->search(search, buf_in, buf_out);
+		}
+
+		__sha1_mb_output(kernel, buf_out, &out[i], n);
+	}
+}
+
+/* Set the result 'search' should look for in sha1_mb_search_find(). */
+void
+sha1_mb_search_target(struct sha1_mb_search *search, const uint32_t target[5])
+{
+	assert(search != NULL);
+	assert(target != NULL);
+
+	memcpy(search->target, target, sizeof search->target);
+	search->reject = rol(target[4], 2);
+}
+
+/* Look for the value in 'values' for which the block 'search' was prepared
+ * for hashes to the target.  Candidates are rejected after round 75 by the
+ * kernel, and only the rare ones that pass are hashed in full by
+ * ds1963s_sha1_compress_raw() and compared.
+ * Returns 0 and stores its index in 'index' if it was found, and -1
+ * otherwise.
+ */
+int
+sha1_mb_search_find(const struct sha1_mb_search *search,
+                    const uint32_t *values, size_t count, size_t *index)
+{
+	const struct sha1_mb_kernel *kernel = sha1_mb_kernel_get();
+	uint32_t buf_in[SHA1_MB_LANES_MAX];
+	uint32_t block[16], out[5];
+	const uint32_t *group;
+	uint32_t mask;
+	size_t i, n;
+	int j, l;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < (size_t)kernel->lanes ? count - i : kernel->lanes;
+
+		if (n == (size_t)kernel->lanes) {
+			group = &values[i];
+		} else {
+			memset(buf_in, 0, sizeof buf_in);
+			memcpy(buf_in, &values[i], n * sizeof *buf_in);
+			group = buf_in;
+		}
+
+		if ( (mask = kernel->find(search, group)) == 0)
+			continue;
+
+		for (l = 0; l < (int)n; l++) {
+			if ( (mask & (1U << l)) == 0)
+				continue;
+
+			for (j = 0; j < 16; j++)
+				block[j] = search->W[j][0];
+			block[search->word] = group[l];
+
+			ds1963s_sha1_compress_raw(block, out);
+			if (memcmp(out, search->target, sizeof out) == 0) {
+				*index = i + l;
+				return 0;
+			}
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,103 @@
+/* sha1-mb.h
+ *
+ * Multi-buffer SHA-1 compression for DS1963S secret recovery.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SHA1_MB_H
+#define SHA1_MB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA1_MB_LANES_MAX	16
+
+/* Precomputed state for hashing blocks that only differ in one word. */
+struct sha1_mb_search
+{
+	int		word;		/* Index of the varying word.        */
+	uint32_t	state[5];	/* A..E before round 'word'.         */
+	uint32_t	target[5];	/* A..E we are looking for.          */
+	uint32_t	reject;		/* A after round 75 for the target.  */
+	uint32_t	W[80][SHA1_MB_LANES_MAX]	/* Schedule with the */
+			__attribute__((aligned(64)));	/* word zeroed.      */
+	uint32_t	WK[80][SHA1_MB_LANES_MAX]	/* Same, with round  */
+			__attribute__((aligned(64)));	/* constants added.  */
+};
+
+struct sha1_mb_kernel
+{
+	const char	*name;
+	int		lanes;
+	int		(*supported)(void);
+	void		(*compress)(const uint32_t *in, uint32_t *out);
+	void		(*search)(const struct sha1_mb_search *search,
+			          const uint32_t *values, uint32_t *out);
+	uint32_t	(*find)(const struct sha1_mb_search *search,
+			        const uint32_t *values);
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const struct sha1_mb_kernel *sha1_mb_kernel_get(void);
+int  sha1_mb_kernel_set(const char *name);
+
+void sha1_mb_compress_raw(const uint32_t (*in)[16], uint32_t (*out)[5],
+                          size_t count);
+void sha1_mb_compress_raw_word(const uint32_t base[16], int word,
+                               const uint32_t *values, uint32_t (*out)[5],
+                               size_t count);
+
+void sha1_mb_search_init(struct sha1_mb_search *search,
+                         const uint32_t block[16], int word);
+void sha1_mb_search(const struct sha1_mb_search *search,
+                    const uint32_t *values, uint32_t (*out)[5], size_t count);
+void sha1_mb_search_target(struct sha1_mb_search *search,
+                           const uint32_t target[5]);
+int  sha1_mb_search_find(const struct sha1_mb_search *search,
+                         const uint32_t *values, size_t count, size_t *index);
+
+/* Kernel instances, see sha1-mb-kernel.h. */
+void sha1_mb_compress_scalar(const uint32_t *in, uint32_t *out);
+void sha1_mb_search_scalar(const struct sha1_mb_search *search,
+                           const uint32_t *values, uint32_t *out);
+uint32_t sha1_mb_find_scalar(const struct sha1_mb_search *search,
+                             const uint32_t *values);
+void sha1_mb_compress_sse2(const uint32_t *in, uint32_t *out);
+void sha1_mb_search_sse2(const struct sha1_mb_search *search,
+                         const uint32_t *values, uint32_t *out);
+uint32_t sha1_mb_find_sse2(const struct sha1_mb_search *search,
+                           const uint32_t *values);
+void sha1_mb_compress_avx2(const uint32_t *in, uint32_t *out);
+void sha1_mb_search_avx2(const struct sha1_mb_search *search,
+                         const uint32_t *values, uint32_t *out);
+uint32_t sha1_mb_find_avx2(const struct sha1_mb_search *search,
+                           const uint32_t *values);
+void sha1_mb_compress_avx512(const uint32_t *in, uint32_t *out);
+void sha1_mb_search_avx512(const struct sha1_mb_search *search,
+                           const uint32_t *values, uint32_t *out);
+uint32_t sha1_mb_find_avx512(const struct sha1_mb_search *search,
+                             const uint32_t *values);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
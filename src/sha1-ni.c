@@ -0,0 +1,90 @@
+/* sha1-ni.c
+ *
+ * SHA-1 compression using the Intel SHA extensions.
+ *
+ * This implements ds1963s_sha1_compress_raw() with SHA1RNDS4, SHA1NEXTE,
+ * SHA1MSG1 and SHA1MSG2.  ABCD is kept in a single register with A in the
+ * highest lane, and E is carried into the next group of 4 rounds by
+ * SHA1NEXTE, which also rotates it.  The message words are kept in the
+ * same reversed lane order in 4 registers, and expanded 4 at a time.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <immintrin.h>
+#include "sha1.h"
+
+/* Rounds 4k to 4k + 3 with round function 'f'.  The message schedule is
+ * computed 3 groups ahead: SHA1MSG1 starts W[4(k+3)], the XOR adds
+ * W[4(k+2)-8], and SHA1MSG2 finishes W[4(k+1)].
+ */
+#define SHA1_NI_ROUNDS(k, f)						\
+	do {								\
+		__m128i *e = &E[(k) % 2];				\
+									\
+		if ((k) == 0)						\
+			*e = _mm_add_epi32(*e, M[0]);			\
+		else							\
+			*e = _mm_sha1nexte_epu32(*e, M[(k) % 4]);	\
+		E[((k) + 1) % 2] = ABCD;				\
+		if ((k) >= 3 && (k) <= 18)				\
+			M[((k) + 1) % 4] = _mm_sha1msg2_epu32(		\
+				M[((k) + 1) % 4], M[(k) % 4]);		\
+		ABCD = _mm_sha1rnds4_epu32(ABCD, *e, f);		\
+		if ((k) >= 1 && (k) <= 16)				\
+			M[((k) + 3) % 4] = _mm_sha1msg1_epu32(		\
+				M[((k) + 3) % 4], M[(k) % 4]);		\
+		if ((k) >= 2 && (k) <= 17)				\
+			M[((k) + 2) % 4] = _mm_xor_si128(		\
+				M[((k) + 2) % 4], M[(k) % 4]);		\
+	} while (0)
+
+void
+ds1963s_sha1_compress_raw_ni(const uint32_t W[16], uint32_t out[5])
+{
+	__m128i ABCD, E[2], M[4];
+	int i;
+
+	/* The words are in host order already, so we only need to reverse
+	 * the lanes.
+	 */
+	for (i = 0; i < 4; i++) {
+		M[i] = _mm_loadu_si128((const __m128i *)&W[i * 4]);
+		M[i] = _mm_shuffle_epi32(M[i], 0x1B);
+	}
+
+	ABCD = _mm_set_epi32(0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476);
+	E[0] = _mm_set_epi32(0xC3D2E1F0, 0, 0, 0);
+	E[1] = _mm_setzero_si128();
+
+	SHA1_NI_ROUNDS( 0, 0); SHA1_NI_ROUNDS( 1, 0); SHA1_NI_ROUNDS( 2, 0);
+	SHA1_NI_ROUNDS( 3, 0); SHA1_NI_ROUNDS( 4, 0); SHA1_NI_ROUNDS( 5, 1);
+	SHA1_NI_ROUNDS( 6, 1); SHA1_NI_ROUNDS( 7, 1); SHA1_NI_ROUNDS( 8, 1);
+	SHA1_NI_ROUNDS( 9, 1); SHA1_NI_ROUNDS(10, 2); SHA1_NI_ROUNDS(11, 2);
+	SHA1_NI_ROUNDS(12, 2); SHA1_NI_ROUNDS(13, 2); SHA1_NI_ROUNDS(14, 2);
+	SHA1_NI_ROUNDS(15, 3); SHA1_NI_ROUNDS(16, 3); SHA1_NI_ROUNDS(17, 3);
+	SHA1_NI_ROUNDS(18, 3); SHA1_NI_ROUNDS(19, 3);
+
+	/* E after the last round is A from 4 rounds before rotated by 30,
+	 * which SHA1NEXTE gives us when there is no feed-forward to add.
+	 */
+	E[0] = _mm_sha1nexte_epu32(E[0], _mm_setzero_si128());
+
+	ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+	_mm_storeu_si128((__m128i *)out, ABCD);
+	out[4] = _mm_extract_epi32(E[0], 3);
+}
@@ -14,8 +14,14 @@
  * 34AA973C D4C4DAA4 F61EEB2B DBAD2731 6534016F
  */
 
-/* #define SHA1HANDSOFF * Copies data before messing with it. */
+/* The context is fully reentrant: SHA1_Transform() works on a copy of
+ * the block on the stack, so the input is never modified.
+ *
+ * ds1963s_sha1_compress_raw() uses the Intel SHA extensions when the CPU
+ * supports them, and the scalar code below otherwise.
+ */
 
+#include <pthread.h>
 #include <string.h>
 #include <netinet/in.h>	/* htonl() */
 #include <net/ppp_defs.h>
@@ -28,9 +34,9 @@ SHA1_Transform(u_int32_t[5], const unsigned char[64]);
 
 /* blk0() and blk() perform the initial expand. */
 /* I got the idea of expanding during the round function from SSLeay */
-#define blk0(i) (block->l[i] = htonl(block->l[i]))
-#define blk(i) (block->l[i&15] = rol(block->l[(i+13)&15]^block->l[(i+8)&15] \
-    ^block->l[(i+2)&15]^block->l[i&15],1))
+#define blk0(i) (block[i])
+#define blk(i) (block[i&15] = rol(block[(i+13)&15]^block[(i+8)&15] \
+    ^block[(i+2)&15]^block[i&15],1))
 
 /* (R0+R1), R2, R3, R4 are the different operations used in SHA1 */
 #define R0(v,w,x,y,z,i) z+=((w&(x^y))^y)+blk0(i)+0x5A827999+rol(v,5);w=rol(w,30);
@@ -40,26 +46,16 @@ SHA1_Transform(u_int32_t[5], const unsigned char[64]);
 #define R4(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0xCA62C1D6+rol(v,5);w=rol(w,30);
 
 
-/* Hash a single 512-bit block. This is the core of the algorithm. */
+/* Run the 80 rounds over the host order words in block[], which are
+ * used as the expansion workspace, without the final feed-forward.
+ */
 
 static void
-SHA1_Transform(u_int32_t state[5], const unsigned char buffer[64])
+SHA1_Compress(u_int32_t state[5], u_int32_t block[16])
 {
     u_int32_t a, b, c, d, e;
-    typedef union {
-	unsigned char c[64];
-	u_int32_t l[16];
-    } CHAR64LONG16;
-    CHAR64LONG16 *block;
-
-#ifdef SHA1HANDSOFF
-    static unsigned char workspace[64];
-    block = (CHAR64LONG16 *) workspace;
-    memcpy(block, buffer, 64);
-#else
-    block = (CHAR64LONG16 *) buffer;
-#endif
-    /* Copy context->state[] to working vars */
+
+    /* Copy state[] to working vars */
     a = state[0];
     b = state[1];
     c = state[2];
@@ -87,14 +83,91 @@ SHA1_Transform(u_int32_t state[5], const unsigned char buffer[64])
     R4(d,e,a,b,c,72); R4(c,d,e,a,b,73); R4(b,c,d,e,a,74); R4(a,b,c,d,e,75);
     R4(e,a,b,c,d,76); R4(d,e,a,b,c,77); R4(c,d,e,a,b,78); R4(b,c,d,e,a,79);
 
+    /* Store the working vars */
+    state[0] = a;
+    state[1] = b;
+    state[2] = c;
+    state[3] = d;
+    state[4] = e;
+}
+
+
+/* Hash a single 512-bit block. This is the core of the algorithm. */
+
+static void
+SHA1_Transform(u_int32_t state[5], const unsigned char buffer[64])
+{
+    u_int32_t block[16], v[5];
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        memcpy(&block[i], &buffer[i * 4], 4);
+        block[i] = ntohl(block[i]);
+    }
+
+    memcpy(v, state, sizeof v);
+    SHA1_Compress(v, block);
+
     /* Add the working vars back into context.state[] */
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-    state[4] += e;
-    /* Wipe variables */
-    a = b = c = d = e = 0;
+    state[0] += v[0];
+    state[1] += v[1];
+    state[2] += v[2];
+    state[3] += v[3];
+    state[4] += v[4];
+}
+
+
+/* Compress a single block of 16 words, already in host order, starting
+ * from the standard initial state.  The result is the internal state
+ * A, B, C, D, E after 80 rounds, without the final feed-forward, which
+ * is what the DS1963S uses for its MACs.
+ */
+
+void
+ds1963s_sha1_compress_raw_scalar(const uint32_t W[16], uint32_t out[5])
+{
+    u_int32_t block[16];
+
+    memcpy(block, W, sizeof block);
+
+    out[0] = 0x67452301;
+    out[1] = 0xEFCDAB89;
+    out[2] = 0x98BADCFE;
+    out[3] = 0x10325476;
+    out[4] = 0xC3D2E1F0;
+    SHA1_Compress(out, block);
+}
+
+static void (*sha1_compress_raw)(const uint32_t[16], uint32_t[5]);
+static pthread_once_t sha1_compress_raw_once = PTHREAD_ONCE_INIT;
+
+static void
+sha1_compress_raw_select(void)
+{
+    sha1_compress_raw = ds1963s_sha1_compress_raw_scalar;
+
+#ifdef HAVE_SHA1_NI
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1"))
+        sha1_compress_raw = ds1963s_sha1_compress_raw_ni;
+#endif
+}
+
+void
+ds1963s_sha1_compress_raw(const uint32_t W[16], uint32_t out[5])
+{
+    pthread_once(&sha1_compress_raw_once, sha1_compress_raw_select);
+    sha1_compress_raw(W, out);
+}
+
+/* Name of the implementation ds1963s_sha1_compress_raw() uses. */
+
+const char *
+ds1963s_sha1_compress_raw_name(void)
+{
+    pthread_once(&sha1_compress_raw_once, sha1_compress_raw_select);
+    return sha1_compress_raw == ds1963s_sha1_compress_raw_scalar ?
+           "scalar" : "sha-ni";
 }
 
 
@@ -164,9 +237,6 @@ SHA1_Final(unsigned char digest[20], SHA1_CTX *context)
     memset(context->state, 0, 20);
     memset(context->count, 0, 8);
     memset(&finalcount, 0, 8);
-#ifdef SHA1HANDSOFF  /* make SHA1Transform overwrite it's own static vars */
-    SHA1Transform(context->state, context->buffer);
-#endif
 }
 
 #if 0
@@ -15,4 +15,17 @@ extern void SHA1_Init(SHA1_CTX *);
 extern void SHA1_Update(SHA1_CTX *, const unsigned char *, unsigned int);
 extern void SHA1_Final(unsigned char[SHA1_SIGNATURE_SIZE], SHA1_CTX *);
 
+/* A single block compression returning A, B, C, D, E as the DS1963S does.
+ * The implementation is picked at runtime from the ones below.
+ */
+extern void ds1963s_sha1_compress_raw(const uint32_t W[16], uint32_t out[5]);
+extern const char *ds1963s_sha1_compress_raw_name(void);
+
+extern void ds1963s_sha1_compress_raw_scalar(const uint32_t W[16],
+                                             uint32_t out[5]);
+#ifdef HAVE_SHA1_NI
+extern void ds1963s_sha1_compress_raw_ni(const uint32_t W[16],
+                                         uint32_t out[5]);
+#endif
+
 #endif /* SHA1_INCLUDE_ */
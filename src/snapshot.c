@@ -0,0 +1,145 @@
+/* snapshot.c
+ *
+ * Snapshots of emulator state that can be restored at memcpy speed.
+ *
+ * All memory a snapshot needs is allocated when regions and coroutines
+ * are added to it, so taking and restoring one only copies memory.  The
+ * coroutines are not torn down and set up again, but get their stack and
+ * context copied back, which makes them continue from where they were
+ * suspended when the snapshot was taken.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+void
+snapshot_init(struct snapshot *snap, struct coroutine_scheduler *sched)
+{
+	assert(snap != NULL);
+	assert(sched != NULL);
+
+	memset(snap, 0, sizeof *snap);
+	snap->sched = sched;
+}
+
+void
+snapshot_destroy(struct snapshot *snap)
+{
+	assert(snap != NULL);
+
+	for (size_t i = 0; i < snap->region_count; i++)
+		free(snap->regions[i].data);
+
+	for (size_t i = 0; i < snap->coro_count; i++)
+		coroutine_snapshot_destroy(&snap->coros[i]);
+
+	free(snap->regions);
+	free(snap->coros);
+}
+
+int
+snapshot_add(struct snapshot *snap, void *addr, size_t size)
+{
+	struct snapshot_region *regions;
+	void *data;
+
+	assert(snap != NULL);
+	assert(addr != NULL);
+
+	if ( (data = malloc(size)) == NULL)
+		return -1;
+
+	regions = realloc(snap->regions,
+	                  (snap->region_count + 1) * sizeof *regions);
+	if (regions == NULL) {
+		free(data);
+		return -1;
+	}
+
+	regions[snap->region_count].addr = addr;
+	regions[snap->region_count].data = data;
+	regions[snap->region_count].size = size;
+	snap->regions = regions;
+	snap->region_count++;
+
+	return 0;
+}
+
+int
+snapshot_add_coroutine(struct snapshot *snap, struct coroutine *coro)
+{
+	struct coroutine_snapshot *coros;
+
+	assert(snap != NULL);
+	assert(coro != NULL);
+	assert(coro->sched == snap->sched);
+
+	coros = realloc(snap->coros, (snap->coro_count + 1) * sizeof *coros);
+	if (coros == NULL)
+		return -1;
+
+	snap->coros = coros;
+	if (coroutine_snapshot_init(&coros[snap->coro_count], coro) == -1)
+		return -1;
+
+	snap->coro_count++;
+	return 0;
+}
+
+/* The scheduler should not be running, or be stopped. */
+void
+snapshot_take(struct snapshot *snap)
+{
+	assert(snap != NULL);
+
+	for (size_t i = 0; i < snap->region_count; i++) {
+		struct snapshot_region *r = &snap->regions[i];
+		memcpy(r->data, r->addr, r->size);
+	}
+
+	for (size_t i = 0; i < snap->coro_count; i++)
+		coroutine_snapshot_take(&snap->coros[i]);
+
+	snap->active_list = snap->sched->active_list;
+	snap->current     = snap->sched->current;
+	snap->stopped     = snap->sched->stopped;
+}
+
+/* Regions are restored before coroutines, so a coroutine embedded in a
+ * region still ends up with the context of its own snapshot.
+ */
+void
+snapshot_restore(struct snapshot *snap)
+{
+	assert(snap != NULL);
+
+	for (size_t i = 0; i < snap->region_count; i++) {
+		struct snapshot_region *r = &snap->regions[i];
+		memcpy(r->addr, r->data, r->size);
+	}
+
+	for (size_t i = 0; i < snap->coro_count; i++)
+		coroutine_snapshot_restore(&snap->coros[i]);
+
+	snap->sched->active_list = snap->active_list;
+	snap->sched->current     = snap->current;
+	snap->sched->stopped     = snap->stopped;
+}
@@ -0,0 +1,67 @@
+/* snapshot.h
+ *
+ * Snapshots of emulator state that can be restored at memcpy speed.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "coroutine.h"
+
+struct snapshot_region
+{
+	void			*addr;
+	void			*data;
+	size_t			size;
+};
+
+/* A snapshot is a set of memory regions, such as the device structures,
+ * and the coroutines of a scheduler that run them.  Together they should
+ * cover every coroutine on the scheduler and all the memory they share,
+ * so that a restore leaves nothing pointing at state that moved on.
+ */
+struct snapshot
+{
+	struct coroutine_scheduler *sched;
+	struct list_head	active_list;
+	struct coroutine	*current;
+	int			stopped;
+	struct snapshot_region	*regions;
+	size_t			region_count;
+	struct coroutine_snapshot *coros;
+	size_t			coro_count;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void snapshot_init(struct snapshot *, struct coroutine_scheduler *);
+void snapshot_destroy(struct snapshot *);
+int  snapshot_add(struct snapshot *, void *, size_t);
+int  snapshot_add_coroutine(struct snapshot *, struct coroutine *);
+void snapshot_take(struct snapshot *);
+void snapshot_restore(struct snapshot *);
+
+#ifdef __cplusplus
+};
+#endif
+
+#endif
@@ -28,6 +28,7 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <termios.h>
 #include "transport-pty.h"
 
 static struct transport_operations transport_pty_operations;
@@ -161,8 +162,79 @@ transport_pty_write(struct transport *t, const void *buf, size_t count)
 	return write_no_EINTR(data->fd, buf, count);
 }
 
+/* The termios of a pty are shared between both ends, so changing them on
+ * the master is what the host sees on the slave.
+ */
+static int
+transport_pty_baudrate_set(struct transport *t, int baudrate)
+{
+	struct transport_pty_data *data;
+	struct termios tio;
+	speed_t speed;
+
+	assert(t != NULL);
+	assert(t->private_data != NULL);
+
+	switch (baudrate) {
+	case 9600:
+		speed = B9600;
+		break;
+	case 19200:
+		speed = B19200;
+		break;
+	case 57600:
+		speed = B57600;
+		break;
+	case 115200:
+		speed = B115200;
+		break;
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	data = t->private_data;
+	if (tcgetattr(data->fd, &tio) == -1)
+		return -1;
+
+	if (cfsetispeed(&tio, speed) == -1 || cfsetospeed(&tio, speed) == -1)
+		return -1;
+
+	return tcsetattr(data->fd, TCSADRAIN, &tio);
+}
+
+static int
+transport_pty_baudrate_get(struct transport *t)
+{
+	struct transport_pty_data *data;
+	struct termios tio;
+
+	assert(t != NULL);
+	assert(t->private_data != NULL);
+
+	data = t->private_data;
+	if (tcgetattr(data->fd, &tio) == -1)
+		return -1;
+
+	switch (cfgetospeed(&tio)) {
+	case B9600:
+		return 9600;
+	case B19200:
+		return 19200;
+	case B57600:
+		return 57600;
+	case B115200:
+		return 115200;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
 static struct transport_operations transport_pty_operations = {
-	.destroy = transport_pty_destroy,
-	.read	 = transport_pty_read,
-	.write	 = transport_pty_write
+	.destroy      = transport_pty_destroy,
+	.read	      = transport_pty_read,
+	.write	      = transport_pty_write,
+	.baudrate_set = transport_pty_baudrate_set,
+	.baudrate_get = transport_pty_baudrate_get
 };
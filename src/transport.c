@@ -100,3 +100,34 @@ int transport_write_all(struct transport *t, const void *buf, size_t size)
 
 	return 0;
 }
+
+/* Set the line speed of 't' to 'baudrate' bits per second.  Transports
+ * without a line speed, such as sockets, return -1 with the error set to
+ * TRANSPORT_ERROR_UNSUPPORTED.
+ */
+int transport_baudrate_set(struct transport *t, int baudrate)
+{
+	assert(t != NULL);
+
+	if (t->t_ops->baudrate_set == NULL) {
+		t->error = TRANSPORT_ERROR_UNSUPPORTED;
+		return -1;
+	}
+
+	return t->t_ops->baudrate_set(t, baudrate);
+}
+
+/* Return the line speed of 't' in bits per second, or -1.  The same
+ * transports as for transport_baudrate_set() are unsupported.
+ */
+int transport_baudrate_get(struct transport *t)
+{
+	assert(t != NULL);
+
+	if (t->t_ops->baudrate_get == NULL) {
+		t->error = TRANSPORT_ERROR_UNSUPPORTED;
+		return -1;
+	}
+
+	return t->t_ops->baudrate_get(t);
+}
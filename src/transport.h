@@ -35,6 +35,8 @@ struct transport_operations
 	int     (*destroy)(struct transport *);
 	ssize_t (*read)(struct transport *, void *buf, size_t size);
 	ssize_t (*write)(struct transport *, const void *buf, size_t size);
+	int     (*baudrate_set)(struct transport *, int baudrate);
+	int     (*baudrate_get)(struct transport *);
 };
 
 struct transport
@@ -54,6 +56,8 @@ ssize_t transport_read(struct transport *t, void *buf, size_t size);
 int     transport_read_all(struct transport *t, void *buf, size_t size);
 ssize_t transport_write(struct transport *t, const void *buf, size_t size);
 int     transport_write_all(struct transport *t, const void *buf, size_t size);
+int     transport_baudrate_set(struct transport *t, int baudrate);
+int     transport_baudrate_get(struct transport *t);
 
 #ifdef __cplusplus
 };
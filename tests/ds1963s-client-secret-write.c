@@ -0,0 +1,84 @@
+/* ds1963s-client-secret-write.c
+ *
+ * Write secrets at unaligned addresses through the direct client backend.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ds1963s-client.h"
+#include "ds1963s-client-direct.h"
+#include "ds1963s-device.h"
+
+static int
+secret_write_check(int address, size_t len)
+{
+	struct ds1963s_client client;
+	struct ds1963s_device dev;
+	uint8_t expected[64];
+	uint8_t data[32];
+
+	ds1963s_dev_init(&dev);
+	memset(dev.secret_memory, 0xAA, sizeof dev.secret_memory);
+	memcpy(expected, dev.secret_memory, sizeof expected);
+
+	for (size_t i = 0; i < len; i++)
+		data[i] = i + 1;
+	memcpy(&expected[address - 0x200], data, len);
+
+	if (ds1963s_client_init_direct(&client, &dev) == -1) {
+		fprintf(stderr, "ds1963s_client_init_direct() failed.\n");
+		return -1;
+	}
+
+	if (ds1963s_client_secret_write_address(&client, address,
+	                                        data, len) == -1) {
+		ds1963s_client_perror(&client, "address 0x%.3x len %zu",
+		                      address, len);
+		ds1963s_client_destroy(&client);
+		return -1;
+	}
+
+	ds1963s_client_destroy(&client);
+
+	if (memcmp(dev.secret_memory, expected, sizeof expected) != 0) {
+		fprintf(stderr, "address 0x%.3x len %zu: secret mismatch\n",
+		        address, len);
+		return -1;
+	}
+
+	return 0;
+}
+
+int
+main(void)
+{
+	int ret = EXIT_SUCCESS;
+
+	if (secret_write_check(0x200, 8) == -1)
+		ret = EXIT_FAILURE;
+
+	if (secret_write_check(0x205, 6) == -1)
+		ret = EXIT_FAILURE;
+
+	if (secret_write_check(0x21C, 4) == -1)
+		ret = EXIT_FAILURE;
+
+	return ret;
+}
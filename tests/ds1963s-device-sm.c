@@ -0,0 +1,534 @@
+/* ds1963s-device-sm.c
+ *
+ * Drive the coroutine and the stackless DS1963S engines with the same bus
+ * traffic, and check that they respond and end up the same.
+ *
+ * Dedicated to Yuzuyu Arielle Huizer.
+ *
+ * Copyright (C) 2019  Ronald Huizer <rhuizer@hexpedition.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "1-wire-bus.h"
+#include "ds1963s-device.h"
+#include "ds1963s-device-sm.h"
+
+#define RANDOM_TRANSACTIONS	2000
+
+/* Every bus event goes to the coroutine engine through the bus master,
+ * and to the stackless engine directly, in lock step.
+ */
+struct engines
+{
+	struct one_wire_bus_member	master;
+	struct ds1963s_device		coro;
+	struct ds1963s_device		sm_dev;
+	struct ds1963s_dev_sm		sm;
+	uint8_t				rom[8];
+	const char			*what;
+	unsigned long			events;
+	int				as_bits;
+	int				failures;
+	uint32_t			random;
+};
+
+static uint32_t
+__random(struct engines *e)
+{
+	uint32_t x = e->random;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return e->random = x;
+}
+
+static void
+__fail(struct engines *e, const char *fmt, int a, int b)
+{
+	if (e->failures++ < 10) {
+		fprintf(stderr, "%s, event %lu: ", e->what, e->events);
+		fprintf(stderr, fmt, a, b);
+		fputc('\n', stderr);
+	}
+}
+
+static void
+__reset(struct engines *e)
+{
+	one_wire_bus_member_reset_pulse(&e->master);
+	ds1963s_dev_sm_reset(&e->sm);
+	e->events++;
+}
+
+/* Compare the device state both engines share on a reset pulse, when
+ * both have finished the function in progress.  'state' and the bus
+ * member are private to the coroutine engine.
+ */
+static void
+__compare(struct engines *e)
+{
+	struct ds1963s_device *a = &e->coro, *b = &e->sm_dev;
+
+	__reset(e);
+
+	for (size_t i = 0; i < sizeof a->memory; i++)
+		if (a->memory[i] != b->memory[i])
+			__fail(e, "memory 0x%.3x differs", i, 0);
+
+	if (a->family != b->family || memcmp(a->serial, b->serial, 6))
+		__fail(e, "ROM code differs", 0, 0);
+	if (a->TA1 != b->TA1 || a->TA2 != b->TA2)
+		__fail(e, "TA %.4x vs %.4x", a->TA2 << 8 | a->TA1,
+		       b->TA2 << 8 | b->TA1);
+	if (a->ES != b->ES)
+		__fail(e, "ES %.2x vs %.2x", a->ES, b->ES);
+	if (a->M != b->M || a->X != b->X || a->HIDE != b->HIDE ||
+	    a->CHLG != b->CHLG || a->AUTH != b->AUTH || a->MATCH != b->MATCH)
+		__fail(e, "M X HIDE CHLG AUTH MATCH flags differ", 0, 0);
+	if (a->OD != b->OD || a->PF != b->PF || a->RC != b->RC ||
+	    a->AA != b->AA)
+		__fail(e, "OD PF RC AA flags differ", 0, 0);
+}
+
+static int
+__bit(struct engines *e, int bit)
+{
+	int a, b;
+
+	a = one_wire_bus_member_tx_bit(&e->master, bit);
+	b = ds1963s_dev_sm_bit(&e->sm, bit);
+	e->events++;
+
+	if (a != b)
+		__fail(e, "bit %d vs %d", a, b);
+
+	return a;
+}
+
+static int
+__byte(struct engines *e, int byte)
+{
+	int a, b;
+
+	/* Bytes can also be sent a bit at a time. */
+	if (e->as_bits) {
+		for (a = b = 0; b < 8; b++)
+			a |= __bit(e, (byte >> b) & 1) << b;
+		return a;
+	}
+
+	a = one_wire_bus_member_tx_byte(&e->master, byte);
+	b = ds1963s_dev_sm_byte(&e->sm, byte);
+	e->events++;
+
+	if (a != b)
+		__fail(e, "byte %.2x vs %.2x", a, b);
+
+	return a;
+}
+
+static void
+__read(struct engines *e, int count)
+{
+	while (count-- > 0)
+		__byte(e, 0xFF);
+}
+
+static void
+__bytes(struct engines *e, const uint8_t *buf, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		__byte(e, buf[i]);
+}
+
+static void
+__address(struct engines *e, int function, int address)
+{
+	__byte(e, function);
+	__byte(e, address & 0xFF);
+	__byte(e, address >> 8);
+}
+
+/* ROM functions. */
+static void
+__skip_rom(struct engines *e)
+{
+	__reset(e);
+	__byte(e, 0xCC);
+}
+
+static void
+__read_rom(struct engines *e)
+{
+	__reset(e);
+	__byte(e, 0x33);
+	__read(e, 8);
+}
+
+/* Match ROM or Overdrive Match ROM, with byte 'bad' of the ROM code
+ * corrupted if it is in range.
+ */
+static void
+__match_rom(struct engines *e, int function, int bad)
+{
+	__reset(e);
+	__byte(e, function);
+	for (int i = 0; i < 8; i++)
+		__byte(e, i == bad ? e->rom[i] ^ 0x10 : e->rom[i]);
+}
+
+/* Search ROM, taking the wrong branch at bit 'bad' if it is in range. */
+static void
+__search_rom(struct engines *e, int bad)
+{
+	__reset(e);
+	__byte(e, 0xF0);
+	for (int i = 0; i < 64; i++) {
+		int bit = (e->rom[i / 8] >> (i % 8)) & 1;
+
+		__bit(e, 1);
+		__bit(e, 1);
+		if (i == bad) {
+			__bit(e, !bit);
+			return;
+		}
+		__bit(e, bit);
+	}
+}
+
+/* Memory functions. */
+static void
+__write_scratchpad(struct engines *e, int address, const uint8_t *buf,
+                   size_t len)
+{
+	__address(e, 0x0F, address);
+	__bytes(e, buf, len);
+	__read(e, 2);
+}
+
+static void
+__read_scratchpad(struct engines *e)
+{
+	__byte(e, 0xAA);
+	__read(e, 3 + 32 + 2 + 2);
+}
+
+static void
+__copy_scratchpad(struct engines *e, int address, int es)
+{
+	__address(e, 0x55, address);
+	__byte(e, es);
+	__read(e, 4);
+}
+
+static void
+__read_memory(struct engines *e, int address, int count)
+{
+	__address(e, 0xF0, address);
+	__read(e, count);
+}
+
+static void
+__erase_scratchpad(struct engines *e, int address)
+{
+	__address(e, 0xC3, address);
+	__read(e, 2);
+}
+
+static void
+__read_auth_page(struct engines *e, int address)
+{
+	__address(e, 0xA5, address);
+	__read(e, 32 + 4 + 4 + 2 + 4);
+}
+
+static void
+__compute_sha(struct engines *e, int address, int control)
+{
+	__address(e, 0x33, address);
+	__byte(e, control);
+	__read(e, 2 + 4);
+}
+
+static void
+__match_scratchpad(struct engines *e, const uint8_t *mac)
+{
+	__byte(e, 0x3C);
+	__bytes(e, mac, 20);
+	__read(e, 2 + 2);
+}
+
+static void
+__check_rom_functions(struct engines *e)
+{
+	e->what = "Read ROM";
+	__read_rom(e);
+	__read_scratchpad(e);
+
+	e->what = "Match ROM";
+	for (int bad = -1; bad < 8; bad++) {
+		__match_rom(e, 0x55, bad);
+		__read_scratchpad(e);
+	}
+
+	e->what = "Search ROM";
+	for (int bad = -1; bad < 64; bad++) {
+		__search_rom(e, bad);
+		__read_scratchpad(e);
+	}
+
+	e->what = "Resume";
+	__match_rom(e, 0x55, -1);
+	__reset(e);
+	__byte(e, 0xA5);
+	__read_scratchpad(e);
+	__match_rom(e, 0x55, 3);
+	__reset(e);
+	__byte(e, 0xA5);
+	__read_scratchpad(e);
+
+	e->what = "Overdrive Skip ROM";
+	__reset(e);
+	__byte(e, 0x3C);
+	__read_scratchpad(e);
+
+	e->what = "Overdrive Match ROM";
+	for (int bad = -1; bad < 8; bad += 4) {
+		__match_rom(e, 0x69, bad);
+		__read_scratchpad(e);
+	}
+
+	__compare(e);
+}
+
+/* Write, read back and copy the scratchpad for data and secret memory at
+ * aligned and unaligned addresses, and read the result.
+ */
+static void
+__check_memory_functions(struct engines *e)
+{
+	static const int addresses[] = {
+		0x000, 0x0A5, 0x1E0, 0x1FF, 0x200, 0x205, 0x21C, 0x23F,
+		0x240, 0x2A0, 0xFFFF
+	};
+	uint8_t buf[32], mac[20];
+
+	for (size_t i = 0; i < sizeof addresses / sizeof *addresses; i++) {
+		int address = addresses[i];
+		int len = 32 - (address & 0x1F);
+
+		for (int j = 0; j < len; j++)
+			buf[j] = __random(e);
+
+		e->what = "Write and Copy Scratchpad";
+		__skip_rom(e);
+		__erase_scratchpad(e, address);
+		__skip_rom(e);
+		__write_scratchpad(e, address, buf, len);
+		__skip_rom(e);
+		__read_scratchpad(e);
+		__skip_rom(e);
+		__copy_scratchpad(e, address, (address & 0x1F) + len - 1);
+		__compare(e);
+
+		/* Write fewer bytes, and copy with a stale ending offset. */
+		__skip_rom(e);
+		__write_scratchpad(e, address, buf, len / 2);
+		__skip_rom(e);
+		__copy_scratchpad(e, address, 0x1F);
+		__compare(e);
+
+		e->what = "Read Memory";
+		__skip_rom(e);
+		__read_memory(e, address, 40);
+
+		e->what = "Read Authenticated Page";
+		__skip_rom(e);
+		__read_auth_page(e, address);
+		__compare(e);
+
+		e->what = "Match Scratchpad";
+		for (int j = 0; j < 20; j++)
+			mac[j] = __random(e);
+		__skip_rom(e);
+		__match_scratchpad(e, mac);
+		__skip_rom(e);
+		__match_scratchpad(e, &e->coro.scratchpad[8]);
+		__compare(e);
+	}
+}
+
+/* Every control byte, with the scratchpad hidden by Erase Scratchpad and
+ * visible after Write Scratchpad, on data and secret pages.
+ */
+static void
+__check_sha_functions(struct engines *e)
+{
+	static const int addresses[] = { 0x000, 0x0E0, 0x1E0, 0x200 };
+	const size_t count = sizeof addresses / sizeof *addresses;
+	uint8_t buf[32];
+
+	e->what = "Compute SHA";
+	for (int control = 0; control < 256; control++) {
+		for (size_t i = 0; i < count; i++) {
+			int address = addresses[i];
+
+			for (int j = 0; j < 32; j++)
+				buf[j] = __random(e);
+
+			__skip_rom(e);
+			__erase_scratchpad(e, address);
+			__skip_rom(e);
+			__compute_sha(e, address, control);
+			__skip_rom(e);
+			__read_scratchpad(e);
+			__compare(e);
+
+			__skip_rom(e);
+			__write_scratchpad(e, address, buf, 32);
+			__skip_rom(e);
+			__compute_sha(e, address, control);
+			__skip_rom(e);
+			__read_scratchpad(e);
+			__skip_rom(e);
+			__match_scratchpad(e, &e->coro.scratchpad[8]);
+			__compare(e);
+		}
+	}
+}
+
+/* Random transactions, which also cut functions short at any point. */
+static void
+__check_random(struct engines *e)
+{
+	static const int functions[] = {
+		0x0F, 0x33, 0x3C, 0x55, 0xA5, 0xAA, 0xC3, 0xF0, 0x12
+	};
+	static const int controls[] = {
+		0x0F, 0xF0, 0x3C, 0xC3, 0xCC, 0xAA, 0x77
+	};
+
+	e->what = "random";
+	for (int i = 0; i < RANDOM_TRANSACTIONS; i++) {
+		int function, address, bad, count;
+
+		switch (__random(e) % 4) {
+		case 0:
+			bad = __random(e) % 8 ? -1 : (int)(__random(e) % 64);
+			__search_rom(e, bad);
+			break;
+		case 1:
+			bad = __random(e) % 4 ? -1 : (int)(__random(e) % 8);
+			__match_rom(e, 0x55, bad);
+			break;
+		case 2:
+			__reset(e);
+			__byte(e, 0xA5);
+			break;
+		default:
+			__skip_rom(e);
+			break;
+		}
+
+		e->as_bits = __random(e) % 6 == 0;
+
+		function = functions[__random(e) % 9];
+		address  = __random(e) % 4 ? __random(e) % 0x2C0
+		                           : __random(e) & 0xFFFF;
+
+		__address(e, function, address);
+		if (function == 0x33)
+			__byte(e, controls[__random(e) % 7]);
+
+		for (count = __random(e) % 48; count > 0; count--)
+			__byte(e, __random(e) % 3 ? 0xFF : __random(e) & 0xFF);
+
+		for (count = __random(e) % 24; count > 0; count--)
+			__bit(e, 1);
+
+		e->as_bits = 0;
+	}
+
+	__compare(e);
+}
+
+static void
+__master(void *data)
+{
+	struct engines *e = (struct engines *)data;
+
+	__check_rom_functions(e);
+	__check_memory_functions(e);
+
+	/* The same once more, with every byte sent as bits. */
+	e->as_bits = 1;
+	__check_rom_functions(e);
+	__check_memory_functions(e);
+	e->as_bits = 0;
+
+	__check_sha_functions(e);
+	__check_random(e);
+}
+
+int
+main(void)
+{
+	static struct engines e;
+	struct coroutine_scheduler sched;
+	struct one_wire_bus bus;
+
+	e.random = 0x1963;
+
+	ds1963s_dev_init(&e.coro);
+	for (size_t i = 0; i < sizeof e.coro.serial; i++)
+		e.coro.serial[i] = __random(&e);
+	for (size_t i = 0; i < sizeof e.coro.memory; i++)
+		e.coro.memory[i] = __random(&e);
+	ds1963s_dev_rom_code_get(&e.coro, e.rom);
+
+	ds1963s_dev_init(&e.sm_dev);
+	memcpy(e.sm_dev.serial, e.coro.serial, sizeof e.sm_dev.serial);
+	memcpy(e.sm_dev.memory, e.coro.memory, sizeof e.sm_dev.memory);
+	ds1963s_dev_sm_init(&e.sm, &e.sm_dev);
+
+	coroutine_scheduler_init(&sched);
+	one_wire_bus_init(&bus, &sched);
+
+	one_wire_bus_member_init(&e.master);
+	one_wire_bus_member_master_set(&e.master);
+	e.master.device = &e;
+	e.master.driver = __master;
+
+	ds1963s_dev_connect_bus(&e.coro, &bus);
+	if (one_wire_bus_member_add(&e.master, &bus) == -1) {
+		fprintf(stderr, "one_wire_bus_member_add() failed.\n");
+		return EXIT_FAILURE;
+	}
+
+	one_wire_bus_run(&bus);
+	coroutine_scheduler_destroy(&sched);
+
+	if (e.failures != 0) {
+		fprintf(stderr, "%d differences in %lu bus events.\n",
+		        e.failures, e.events);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}